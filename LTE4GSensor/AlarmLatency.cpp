@@ -0,0 +1,127 @@
+/*
+*	AlarmLatency.cpp, Copyright (c) 2022 Jonathan Mackey
+*	Traces the latency of an alarm from the thermometer reading to the SMSC.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "AlarmLatency.h"
+
+const char kConfirmStageStr[] PROGMEM = "Confirm";
+const char kDetectStageStr[] PROGMEM = "Detect";
+const char kQueueStageStr[] PROGMEM = "Queue";
+const char kPromptStageStr[] PROGMEM = "Prompt";
+const char kAcceptStageStr[] PROGMEM = "Accept";
+const char kTotalStageStr[] PROGMEM = "Total";
+
+const char* const kStageNames[] PROGMEM =
+{
+	kConfirmStageStr,
+	kDetectStageStr,
+	kQueueStageStr,
+	kPromptStageStr,
+	kAcceptStageStr,
+	kTotalStageStr
+};
+
+/******************************** AlarmLatency ********************************/
+AlarmLatency::AlarmLatency(void)
+{
+	Reset();
+}
+
+/*********************************** Reset ************************************/
+void AlarmLatency::Reset(void)
+{
+	memset(mLast, 0, sizeof(mLast));
+	memset(mMax, 0, sizeof(mMax));
+	memset(mBuckets, 0, sizeof(mBuckets));
+	mCount = 0;
+	mTracing = false;
+}
+
+/*********************************** Start ************************************/
+void AlarmLatency::Start(
+	uint32_t	inConversionStart,
+	uint32_t	inScratchPadRead)
+{
+	mPoints[eConversionStart] = inConversionStart;
+	mPoints[eScratchPadRead] = inScratchPadRead;
+	mPoints[eAlarmQueued] = millis();
+	mTracing = true;
+}
+
+/*********************************** Finish ***********************************/
+/*
+*	Stage n is the time from trace point n to trace point n+1.
+*/
+void AlarmLatency::Finish(
+	uint32_t	inCMGSSent,
+	uint32_t	inPromptReceived,
+	uint32_t	inSMSAccepted)
+{
+	if (mTracing)
+	{
+		mTracing = false;
+		mPoints[eCMGSSent] = inCMGSSent;
+		mPoints[ePromptReceived] = inPromptReceived;
+		mPoints[eSMSAccepted] = inSMSAccepted;
+		if (mCount < 0xFF)
+		{
+			mCount++;
+		}
+		for (uint8_t stage = 0; stage < eStages; stage++)
+		{
+			uint32_t	latency = stage == eTotalStage ?
+							mPoints[eSMSAccepted] - mPoints[eConversionStart] :
+							mPoints[stage+1] - mPoints[stage];
+			mLast[stage] = latency;
+			if (latency > mMax[stage])
+			{
+				mMax[stage] = latency;
+			}
+			uint8_t&	count = mBuckets[stage][Bucket(latency)];
+			if (count < 0xFF)
+			{
+				count++;
+			}
+		}
+	}
+}
+
+/*********************************** Bucket ***********************************/
+uint8_t AlarmLatency::Bucket(
+	uint32_t	inLatency)
+{
+	uint8_t	bucket = 0;
+	inLatency /= kBucket0Limit;
+	while (inLatency &&
+		bucket < (kBuckets - 1))
+	{
+		inLatency >>= 1;
+		bucket++;
+	}
+	return(bucket);
+}
+
+/******************************** GetStageStr *********************************/
+const __FlashStringHelper* AlarmLatency::GetStageStr(
+	uint8_t	inStage)
+{
+	return((const __FlashStringHelper*)pgm_read_word(&kStageNames[inStage]));
+}
@@ -0,0 +1,106 @@
+/*
+*	AlarmLatency.h, Copyright (c) 2022 Jonathan Mackey
+*	Traces the latency of an alarm from the thermometer reading to the SMSC.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef AlarmLatency_h
+#define AlarmLatency_h
+
+#include <Arduino.h>
+
+/*
+*	An alarm is traced from the start of the conversion of the first reading
+*	beyond the limit to the SMSC accepting the alarm SMS (+CMGS.)  The trace
+*	points split the latency into stages.  Each stage, and the total, is
+*	kept as a log2 histogram along with the last and max latency.
+*
+*	Bucket 0 is < 128ms, bucket b is < 128ms << b, and the last bucket holds
+*	everything longer.  The counts saturate at 255.
+*/
+class AlarmLatency
+{
+public:
+	enum ETracePoint
+	{
+		eConversionStart,	// Of the first reading beyond the limit
+		eScratchPadRead,	// Of the reading that raised the alarm
+		eAlarmQueued,		// UpdateActions queued the alarm SMS
+		eCMGSSent,			// AT+CMGS of the send that succeeded
+		ePromptReceived,	// '>' prompt
+		eSMSAccepted,		// +CMGS result
+		eTracePoints
+	};
+	enum EStage
+	{
+		eConfirmStage,		// Conversion start to read, includes confirmation
+		eDetectStage,		// Read to queued
+		eQueueStage,		// Queued to AT+CMGS, includes failed attempts
+		ePromptStage,		// AT+CMGS to '>'
+		eAcceptStage,		// '>' to +CMGS
+		eTotalStage,		// Conversion start to +CMGS
+		eStages
+	};
+							AlarmLatency(void);
+							// Starts a trace, the alarm is queued now.
+	void					Start(
+								uint32_t				inConversionStart,
+								uint32_t				inScratchPadRead);
+	bool					IsTracing(void) const
+								{return(mTracing);}
+							// Ends the trace and adds it to the histograms.
+	void					Finish(
+								uint32_t				inCMGSSent,
+								uint32_t				inPromptReceived,
+								uint32_t				inSMSAccepted);
+	void					Cancel(void)
+								{mTracing = false;}
+	void					Reset(void);
+	uint8_t					Count(void) const
+								{return(mCount);}
+	uint32_t				Last(
+								uint8_t					inStage) const
+								{return(mLast[inStage]);}
+	uint32_t				Max(
+								uint8_t					inStage) const
+								{return(mMax[inStage]);}
+	uint8_t					BucketCount(
+								uint8_t					inStage,
+								uint8_t					inBucket) const
+								{return(mBuckets[inStage][inBucket]);}
+							// Upper limit of inBucket in ms
+	static uint32_t			BucketLimit(
+								uint8_t					inBucket)
+								{return((uint32_t)kBucket0Limit << inBucket);}
+	static uint8_t			Bucket(
+								uint32_t				inLatency);
+	static const __FlashStringHelper* GetStageStr(
+								uint8_t					inStage);
+	static const uint8_t	kBuckets = 14;
+	static const uint16_t	kBucket0Limit = 128;	// ms
+protected:
+	uint32_t	mPoints[eTracePoints];
+	uint32_t	mLast[eStages];
+	uint32_t	mMax[eStages];
+	uint8_t		mBuckets[eStages][kBuckets];
+	uint8_t		mCount;
+	bool		mTracing;
+};
+
+#endif // AlarmLatency_h
@@ -26,7 +26,11 @@
 #include "LTESensor.h"
 #include "ATmega644RTC.h"
 #include "OneWire.h"
+#include "OneWireAsync.h"
 #include "DS18B20Multidrop.h"
+#include "TempHistory.h"
+#include "SensorScheduler.h"
+#include "PowerGovernor.h"
 
 
 TFT_ST7789	display(Config::kDCPin, Config::kResetPin,
@@ -39,7 +43,15 @@ LTESensor	lteSensor;
 #include "MyriadPro-Regular_18.h"
 
 OneWire  oneWire(Config::kOneWirePin);
-DS18B20Multidrop	thermometers(oneWire, 10000, 27*16);	// 10000 = update every 10 seconds.  27 = alarm high 27C
+OneWireAsync	oneWireAsync(Config::kOneWirePin);	// Uses Timer1
+// Additional buses can be added on the unused pins, e.g.
+//OneWire  oneWire2(Config::kUnusedPinA2);	// thermometers.AddBus(oneWire2) in setup()
+DS18B20MultidropN<4>	thermometers(oneWire, 10000, 27*16);	// 10000 = update every 10 seconds.  27 = alarm high 27C
+TempHistoryN<4, 384>	history(5*60000L);	// 5 minute windows, ~13 hours, 440 bytes of SRAM
+SensorScheduler	scheduler;
+PowerGovernor	governor(5*60000L, 72);	// Alarms within 5 minutes, aim for 72 hours of battery
+// A DS3231 (e.g. the external RTC, include DS3231SN.h) adds a reference temperature
+//DS3231SN	externalRTC;	// scheduler.AddSensor(externalRTC) in setup()
 
 /*********************************** setup ************************************/
 void setup(void)
@@ -68,7 +80,20 @@ void setup(void)
 	display.begin(DISPLAY_ROTATION); // Init TFT
 	display.Fill();
 
+	thermometers.SetTruncatedReads(6);	// Full CRC checked read every 6th update (1 minute)
+	thermometers.SetAdaptiveSampling(6);	// Stable probes are read as seldom as once a minute
+	//thermometers.SetOversampling(4);	// Average 4 fast 9 bit conversions per update
+	oneWireAsync.begin();
+	thermometers.SetAsyncEngine(&oneWireAsync);
+	thermometers.SetROMCache(Config::kROMCacheAddr);
+	thermometers.SetAlarmFilter(8, 2);	// 0.5C hysteresis, 2 readings to confirm
+	thermometers.SetTrendAlarm(60);	// Warn when a limit is projected within an hour
 	thermometers.begin();
+	scheduler.AddSensor(thermometers);
+	lteSensor.SetScheduler(&scheduler);
+	governor.begin(&thermometers);
+	lteSensor.SetPowerGovernor(&governor);
+	lteSensor.SetHistory(&history);
 	lteSensor.begin(&thermometers, &display, &MyriadPro_Regular_36_1b::font,
 												&MyriadPro_Regular_18::font);
 }
@@ -26,7 +26,12 @@
 
 #include "LTESensor.h"
 #include "DS18B20Multidrop.h"
+#include "TempHistory.h"
+#include "SensorScheduler.h"
+#include "PowerGovernor.h"
+#include "OneWireAsync.h"
 #include "SIM7000.h"
+#include "SIM7000ATCmdHash.h"
 #include "SerialUtils.h"
 #include "ATmega644RTC.h"
 
@@ -61,13 +66,17 @@ const char kSetupStr[] PROGMEM = "setup";
 const char kOnStr[] PROGMEM = "on";
 const char kOffStr[] PROGMEM = "off";
 const char kQueryStr[] PROGMEM = "?";
+const char kHistoryStr[] PROGMEM = "hist";
+const char kLatencyStr[] PROGMEM = "lat";
 
 const char* const kSMSCommands[] PROGMEM =
 {
 	kSetupStr,
 	kOnStr,
 	kOffStr,
-	kQueryStr
+	kQueryStr,
+	kHistoryStr,
+	kLatencyStr
 };
 enum ESMSCommand
 {
@@ -75,9 +84,14 @@ enum ESMSCommand
 	eSetupCmd,
 	eOnCmd,
 	eOffCmd,
-	eQueryCmd
+	eQueryCmd,
+	eHistoryCmd,
+	eLatencyCmd
 };
 
+// Length of "\nSignal: 3.8 (5 = best)\nBattery: 100%", see DoQueryCmdReply
+const uint8_t	kQueryTailLength = 37;
+
 const char kOKStr[] PROGMEM = "OK";
 const char kSetViaSMSWarningStr[] PROGMEM = "Set via SMS";
 const char kTestSMSSentStr[] PROGMEM = "Test SMS Sent";
@@ -109,7 +123,11 @@ const SStringDesc kTextDesc[] PROGMEM =
 LTESensor::LTESensor(void)
 : SIM7000(Serial1, Config::kSIMRxPin, Config::kSIMTxPin,
 					Config::kSIMPowerKeyPin, Config::kSIMResetPin),
-	mDebouncePeriod(DEBOUNCE_DELAY), mSleepEnabled(true), mSMSReply(eNoReply)
+	mHistory(nullptr), mScheduler(nullptr), mGovernor(nullptr),
+	mDebouncePeriod(DEBOUNCE_DELAY), mSMSDeferPeriod(SMS_DEFER_PERIOD),
+	mMaxThermometerUpdateTime(0),
+	mSMSReply(eNoReply), mSentSMSReply(eNoReply), mDisplacedSMSReply(eNoReply),
+	mSMSRetries(0), mSleepEnabled(true), mTrendAlarmSent(false)
 {
 }
 
@@ -122,6 +140,14 @@ void LTESensor::begin(
 {
 	SIM7000::SetPassthrough(&Serial);
 	SIM7000::begin();
+#ifdef SUPPORT_GNSS
+	RegisterURCHandler(kCGNSINFCmdHash,
+				static_cast<URCHandler>(&LTESensor::HandleGNSSInfo));
+	mGNSSPowerRequested = false;
+	mGNSSFixWanted = true;
+	mGNSSPeriod.Set(GNSS_POLL_PERIOD);
+	mGNSSPeriod.Start();
+#endif
 	
 	mThermometers = inThermometers;
 	
@@ -209,9 +235,53 @@ void LTESensor::begin(
 */
 void LTESensor::GiveTime(void)
 {
-	bool	dataWasUpdated = mThermometers->Update(true);
+	uint32_t	startTime = micros();
+	bool	dataWasUpdated;
+	/*
+	*	The alarms are maintained by the alarm filter, see SetAlarmFilter.
+	*	With a scheduler the thermometers are run along with any other sensors,
+	*	one sensor per call.
+	*/
+	if (mScheduler)
+	{
+		mScheduler->Update();
+		dataWasUpdated = mThermometers->TakeNewReading();
+	} else
+	{
+		dataWasUpdated = mThermometers->Update(false);
+	}
+	uint32_t	updateTime = micros() - startTime;
+	if (updateTime > mMaxThermometerUpdateTime)
+	{
+		mMaxThermometerUpdateTime = updateTime;
+	}
+	if (mGovernor &&
+		mGovernor->Update(SIM7000::BatteryLevel()))
+	{
+		SIM7000::SetCheckLevelsPeriod(CheckLevelsPeriod(mSleepLevel == eAwake));
+		UnixTime::SetSleepDelay(mGovernor->SleepDelay());
+	}
 	UpdateDisplay();
 	UpdateActions();
+	if (mHistory)
+	{
+		if (dataWasUpdated)
+		{
+			uint8_t	count = mThermometers->GetCount();
+			if (count != mHistory->GetCount())
+			{
+				mHistory->begin(count);	// The indexes may have changed
+			}
+			for (uint8_t i = 0; i < count; i++)
+			{
+				if (mThermometers->IsValid(i))
+				{
+					mHistory->AddReading(i, mThermometers->GetTemperature(i));
+				}
+			}
+		}
+		mHistory->Update();
+	}
 	if (dataWasUpdated)
 	{
 		mThermometers->ResetTemperatureChanged();
@@ -427,6 +497,8 @@ void LTESensor::UpdateDisplay(void)
 				{
 					char tempStr[20];
 					uint8_t	count = mThermometers->GetCount();
+					// Only the lines above eRSSITimeBatItem are available.
+					if (count > eRSSITimeBatItem) count = eRSSITimeBatItem;
 					for (uint8_t i = 0; i < count; i++)
 					{
 						if (updateAll ||
@@ -610,32 +682,147 @@ void LTESensor::UpdateActions(void)
 			*
 			*	mWaitingToTurnAlarmOff makes the assumption that there is only
 			*	one SMS being sent at any time.
+			*
+			*	The latency trace starts with the trace points of the raise.
 			*/
-			mWaitingToTurnAlarmOff = QueueSMSReply(eQueryReply);
+			mWaitingToTurnAlarmOff = QueueSMSReply(eAlarmReply);
+			uint32_t	conversionStart, read;
+			if (mWaitingToTurnAlarmOff &&
+				mThermometers->TakeAlarmTrace(conversionStart, read))
+			{
+				mLatency.Start(conversionStart, read);
+			}
 		} else if (SMSStatus() >= eSMSSent)
 		{
 			/*
-			*	This doesn't handle the case where the send fails other than
-			*	treating it the same as successfully sent. The SMS is only sent
-			*	if there is an established connection to a tower.  A failure to
-			*	send at this point in the code would be considered a fatal
-			*	error, either a coding error or provisioning error. Either way I
-			*	don't know how an error should be handled in this case. It's not
-			*	like you can keep trying to send an SMS if you don't understand
-			*	why it's failing.
+			*	A failed send (error or timeout, generally a marginal signal)
+			*	is requeued till the retries are exhausted.  After that it's
+			*	treated the same as successfully sent.
 			*/
+			bool	failed = SMSStatus() == eSMSFailed;
 			ResetSMSStatus(); // SMS result handled.  Allow new SMSs to be sent.
-			if (mWaitingToTurnAlarmOff)
+			if (failed &&
+				mSMSRetries &&
+				mSMSReply == eNoReply)
+			{
+				mSMSRetries--;
+				mSMSReply = mSentSMSReply;
+				mSMSRetryPeriod.Set(mSentSMSReply >= eAlarmReply ?
+										SMS_RETRY_PERIOD : SMS_DEFER_PERIOD);
+				mSMSRetryPeriod.Start();
+			} else
 			{
-				mWaitingToTurnAlarmOff = false;
 				/*
-				*	Turning the alarm off will require the user to turn it
-				*	back on in order to continue monitoring the thermometers.
-				*	The user can still manually send an SMS to get the status.
+				*	A non-urgent reply that failed while an alarm waited for
+				*	the slot is requeued after the alarm.
+				*/
+				if (failed &&
+					mSentSMSReply < eAlarmReply &&
+					mSMSReply >= eAlarmReply)
+				{
+					mDisplacedSMSReply = mSentSMSReply;
+				}
+				/*
+				*	The latency trace ends when the SMSC accepts the alarm
+				*	SMS.  An alarm that couldn't be sent isn't traced.
+				*/
+				if (mSentSMSReply == eAlarmReply)
+				{
+					if (failed)
+					{
+						mLatency.Cancel();
+					} else
+					{
+						mLatency.Finish(SMSStartTime(), SMSPromptTime(),
+											SMSResultTime());
+					}
+				}
+				if (mWaitingToTurnAlarmOff &&
+					mSentSMSReply == eAlarmReply)
+				{
+					mWaitingToTurnAlarmOff = false;
+					/*
+					*	Turning the alarm off will require the user to turn it
+					*	back on in order to continue monitoring the
+					*	thermometers.  The user can still manually send an SMS
+					*	to get the status.
+					*/
+					SetAlarm(false);
+				}
+				/*
+				*	A reply displaced by an alarm is requeued once the slot
+				*	is free.
 				*/
-				SetAlarm(false);
+				if (mDisplacedSMSReply != eNoReply &&
+					QueueSMSReply(mDisplacedSMSReply))
+				{
+					mDisplacedSMSReply = eNoReply;
+				}
 			}
 		}
+		/*
+		*	A trend alarm SMS warns that a thermometer is heading toward a
+		*	limit.  It's sent once per trend alarm and the alarm is left on
+		*	so that the threshold alarm SMS still follows if the limit is
+		*	reached.
+		*/
+		if (mThermometers->TrendAlarm())
+		{
+			if (mThermometers->DataIsValid() &&
+				mAlarmIsOn &&
+				!mWaitingToTurnAlarmOff &&
+				!mTrendAlarmSent)
+			{
+				mTrendAlarmSent = QueueSMSReply(eTrendAlarmReply);
+			}
+		} else
+		{
+			mTrendAlarmSent = false;
+		}
+		/*
+		*	Replies are normally sent when the previous command completes.
+		*	Replies deferred waiting for a better signal or a retry are sent
+		*	from here.
+		*/
+		if (mSMSReply != eNoReply &&
+			ClearToSendSMS())
+		{
+			ProcessQueuedSMSReply();
+		}
+	#ifdef SUPPORT_GNSS
+		/*
+		*	While a fix is wanted, periodically request the GNSS navigation
+		*	info.  If the GNSS engine isn't running (e.g. after the SIM7000
+		*	wakes from sleep) it's turned on first.  Once a fix is taken, or
+		*	the display sleeps, the engine is turned off till the display
+		*	wakes.  Nothing is sent while an SMS is in progress.
+		*/
+		if (SMSStatus() == eSMSIdle &&
+			ClearToSend())
+		{
+			if (mGNSSFixWanted)
+			{
+				if (mGNSSPeriod.Passed())
+				{
+					bool	sent;
+					if (mGNSSPowerRequested)
+					{
+						sent = RequestGNSSInfo();
+					} else
+					{
+						sent = mGNSSPowerRequested = SetGNSSPower(true);
+					}
+					if (sent)
+					{
+						mGNSSPeriod.Start();
+					}
+				}
+			} else if (mGNSSPowerRequested)
+			{
+				mGNSSPowerRequested = !SetGNSSPower(false);
+			}
+		}
+	#endif
 	}
 #ifdef SUPPORT_PERIODIC_SLEEP
 // NOT fully implemented, see notes above
@@ -653,7 +840,7 @@ void LTESensor::UpdateActions(void)
 			*	mWaitingToTurnAlarmOff makes the assumption that there is only
 			*	one SMS being sent at any time.
 			*/
-			mWaitingToTurnAlarmOff = QueueSMSReply(eQueryReply);
+			mWaitingToTurnAlarmOff = QueueSMSReply(eAlarmReply);
 		}
 	} else if (sWatchdogTick)
 	{
@@ -825,6 +1012,207 @@ void LTESensor::UpdateActions(void)
 			case 'S':	// Return the SMS status
 				Serial.print(F("SMS Status = "));
 				Serial.print(mSMSStatus, DEC);
+				Serial.print(F(", sent = "));
+				Serial.print(SMSSentCount());
+				Serial.print(F(", failed = "));
+				Serial.print(SMSFailedCount());
+				Serial.print(F(", mean accept ms = "));
+				Serial.print(MeanSMSAcceptTime());
+				Serial.print(F("\nRSSI x16 = "));
+				Serial.print(SmoothedRSSI());
+				Serial.print(F(", trend = "));
+				Serial.print(RSSITrend());
+				Serial.print('\n');
+				break;
+			case 'B':	// Dump and reset the SIM7000 Rx parse statistics
+				Serial.print(F("Rx bytes = "));
+				Serial.print(RxBytes());
+				Serial.print(F(", lines = "));
+				Serial.print(RxLines());
+				Serial.print(F(", peak = "));
+				Serial.print(RxPeakLength());
+				Serial.print(F(", overruns = "));
+				Serial.print(RxOverruns());
+				Serial.print('\n');
+				ResetRxStats();
+				break;
+			case 'H':	// Dump the temperature history summary
+				if (mHistory)
+				{
+					char	historyStr[240];
+					CreateHistoryStr(historyStr);
+					Serial.print(historyStr);
+					Serial.print(F("\nBytes per sensor = "));
+					Serial.print(mHistory->BytesPerSensor());
+					Serial.print(F(", max append us = "));
+					Serial.print(mHistory->MaxAppendTime());
+					Serial.print('\n');
+				}
+				break;
+			case 'T':	// Dump the thermometer statistics
+				Serial.print(F("Conversion ms = "));
+				Serial.print(mThermometers->ConversionTime());
+				Serial.print(F(", max = "));
+				Serial.print(mThermometers->MaxConversionTime());
+				Serial.print(F("\nSweep us = "));
+				Serial.print(mThermometers->SweepBusTime());
+				Serial.print(F(", alarm search us = "));
+				Serial.print(mThermometers->AlarmSearchBusTime());
+				Serial.print(F(", hits = "));
+				Serial.print(mThermometers->AlarmSearchHits());
+				Serial.print(F("\nTruncated reads = "));
+				Serial.print(mThermometers->TruncatedReads());
+				Serial.print(F(", saved us = "));
+				Serial.print(mThermometers->TruncatedReadSavings());
+				Serial.print(F(", CRC failures = "));
+				Serial.print(mThermometers->CRCFailures());
+				Serial.print(F("\nSkipped reads = "));
+				Serial.print(mThermometers->SkippedReads());
+				Serial.print(F(", conversions = "));
+				Serial.print(mThermometers->SkippedConversions());
+				Serial.print(F("\nOversamples = "));
+				Serial.print(mThermometers->GetOversampling());
+				Serial.print(F(", burst us = "));
+				Serial.print(mThermometers->BurstTime());
+				Serial.print('\n');
+				for (uint8_t i = 0; i < mThermometers->GetCount(); i++)
+				{
+					const SDS18B20Info&	info = mThermometers->GetInfo(i);
+					Serial.print(i);
+					Serial.print(F(": bus = "));
+					Serial.print(info.bus);
+					if (mThermometers->IsParasitePowered(info.bus))
+					{
+						Serial.print(F(" (parasite)"));
+					}
+					Serial.print(F(", family = "));
+					Serial.print(DS18B20Multidrop::FamilyChar(info.family));
+					Serial.print(F(", bits = "));
+					Serial.print(info.resolution + 9);
+					Serial.print(F(", conv ms = "));
+					Serial.print(info.conversionTime * 4);
+					Serial.print(F(", interval = "));
+					Serial.print(info.interval);
+					Serial.print(F(", crc = "));
+					Serial.print(info.crcErrors);
+					Serial.print(F(", presence = "));
+					Serial.print(info.presenceFailures);
+					Serial.print(F(", retries = "));
+					Serial.print(info.retries);
+					Serial.print(F(", 85C = "));
+					Serial.print(info.powerOnReads);
+					if (mThermometers->GetOversampling() > 1)
+					{
+						const SDS18B20Filter&	filter = mThermometers->GetFilter(i);
+						Serial.print(F(", mean/256 = "));
+						Serial.print(filter.value);
+						Serial.print(F(", var/256 = "));
+						Serial.print(filter.variance);
+					}
+					Serial.print(F(", slope/16 C/h = "));
+					Serial.print(mThermometers->GetSlope(i));
+					if (mThermometers->TrendAlarm(i))
+					{
+						Serial.print(F(", alarm in min = "));
+						Serial.print(mThermometers->GetTimeToAlarm(i));
+					}
+					Serial.print('\n');
+				}
+				Serial.print(F("Max update us = "));
+				Serial.print(mMaxThermometerUpdateTime);
+				mMaxThermometerUpdateTime = 0;
+				if (mThermometers->GetAsyncEngine())
+				{
+					Serial.print(F(", max masked us = "));
+					Serial.print(mThermometers->GetAsyncEngine()->MaxMaskedTime());
+					mThermometers->GetAsyncEngine()->ResetMaxMaskedTime();
+				}
+				Serial.print('\n');
+				if (mScheduler)
+				{
+					Serial.print(F("Max sensor run us = "));
+					Serial.print(mScheduler->MaxRunTime());
+					Serial.print(F(", sensor = "));
+					Serial.print(mScheduler->MaxRunSensor());
+					Serial.print('\n');
+					mScheduler->ResetMaxRunTime();
+					for (uint8_t i = 0; i < mScheduler->GetSensorCount(); i++)
+					{
+						const ScheduledSensor*	sensor = mScheduler->GetSensor(i);
+						if (sensor == mThermometers)
+						{
+							continue;
+						}
+						Serial.print(F("Sensor "));
+						Serial.print(i);
+						Serial.print(':');
+						for (uint8_t ch = 0; ch < sensor->GetChannelCount(); ch++)
+						{
+							Serial.print(' ');
+							if (sensor->ReadingIsValid(ch))
+							{
+								Serial.print(sensor->GetReading(ch));
+								Serial.print(sensor->GetChannelType(ch) ==
+										ScheduledSensor::eTemperature ? F("/16C") : F("/16"));
+							} else
+							{
+								Serial.print('-');
+							}
+						}
+						Serial.print('\n');
+					}
+				}
+				break;
+			case 'P':	// Dump the power governor state
+				if (mGovernor)
+				{
+					Serial.print(F("Policy = "));
+					Serial.print(mGovernor->Policy());
+					Serial.print(F(", battery = "));
+					Serial.print(SIM7000::BatteryLevel());
+					Serial.print(F("%, rate = "));
+					Serial.print(mGovernor->DischargeRate());
+					Serial.print(F("/16%/h, runtime h = "));
+					uint16_t	runtime = mGovernor->ProjectedRuntime();
+					if (runtime != PowerGovernor::kUnknownRuntime)
+					{
+						Serial.print(runtime);
+					} else
+					{
+						Serial.print('?');
+					}
+					Serial.print(F("\nThermometer ms = "));
+					Serial.print(mGovernor->ThermometerPeriod());
+					Serial.print(F(", sleep delay s = "));
+					Serial.print(mGovernor->SleepDelay());
+					Serial.print('\n');
+				}
+				break;
+			case 'L':	// Dump the alarm latency histograms
+				Serial.print(F("Alarm latency traces = "));
+				Serial.print(mLatency.Count());
+				Serial.print(F(", ms last, max, buckets <"));
+				Serial.print(AlarmLatency::BucketLimit(0));
+				Serial.print(F(" x2 ..."));
+				for (uint8_t stage = 0; stage < AlarmLatency::eStages; stage++)
+				{
+					Serial.print('\n');
+					Serial.print(AlarmLatency::GetStageStr(stage));
+					Serial.print(F(": "));
+					Serial.print(mLatency.Last(stage));
+					Serial.print(F(", "));
+					Serial.print(mLatency.Max(stage));
+					Serial.print(',');
+					for (uint8_t bucket = 0; bucket < AlarmLatency::kBuckets; bucket++)
+					{
+						Serial.print(' ');
+						Serial.print(mLatency.BucketCount(stage, bucket));
+					}
+				}
+				if (mLatency.IsTracing())
+				{
+					Serial.print(F("\n(Tracing)"));
+				}
 				Serial.print('\n');
 				break;
 		}
@@ -992,6 +1380,9 @@ void LTESensor::SetAlarm(
 		EEPROM.get(Config::kFlagsAddr, flags);
 		if (mAlarmIsOn)
 		{
+			mThermometers->ResetAlarm();	// Clear any latched alarms
+			mThermometers->ResetAlarmTrace();	// Raised while off, not traced
+			mTrendAlarmSent = false;
 			flags &= ~_BV(Config::kAlarmIsOffBit);	// 0
 		} else
 		{
@@ -1255,11 +1646,15 @@ char* LTESensor::CreateIndexedTempStr(
 	// Note that a colon is used in place of square brackets to conform to the
 	// single byte sms characters set (square brackets would be 2 bytes each.)
 	// See TPDU::Pack7BitToPDU() for the list of limitations.
-	outStr[0] = ' ';
-	outStr[1] = inIndex + '0';	// Assumes inIndex 0 to 9
-	outStr[2] = ':';
-	outStr[3] = ' ';
-	outStr+=4;
+	*(outStr++) = ' ';
+	if (inIndex > 9)
+	{
+		*(outStr++) = (inIndex / 10) + '0';	// Assumes inIndex 0 to 99
+	}
+	outStr[0] = (inIndex % 10) + '0';
+	outStr[1] = ':';
+	outStr[2] = ' ';
+	outStr+=3;
 	outStr += mThermometers->CreateTempStr(inIndex, mTempIsCelsius, true, inUse7Bit, outStr);
 	outStr += (inUse7Bit ? 3 : 5);
 	if (inAppendAsteriskIfAlarm &&
@@ -1480,8 +1875,11 @@ void LTESensor::WakeUpDisplay(void)
 		mIgnoreButtonPress = sButtonPressed;
 		mDisplay->WakeUp();
 		mPrevMode = eForceRedraw;
-		SIM7000::SetCheckLevelsPeriod(10000);	// Every 10 seconds
-		mThermometers->begin();	// Update sensor list
+	#ifdef SUPPORT_GNSS
+		mGNSSFixWanted = true;
+	#endif
+		SIM7000::SetCheckLevelsPeriod(CheckLevelsPeriod(true));
+		mThermometers->Refresh();	// Verify sensor list, keeps readings
 	}
 	WakeUpSIM7000();
 	mSleepLevel = eAwake;	// Overrides value set in WakeUpSIM7000()
@@ -1502,6 +1900,19 @@ void LTESensor::WakeUpSIM7000(void)
 	UnixTime::ResetSleepTime();
 }
 
+/***************************** CheckLevelsPeriod ******************************/
+/*
+*	The modem signal and battery levels are checked more often while the
+*	display is awake.  The power governor scales the period by its policy.
+*/
+uint32_t LTESensor::CheckLevelsPeriod(
+	bool	inDisplayIsAwake) const
+{
+	uint32_t	period = inDisplayIsAwake ?
+							AWAKE_CHECK_LEVELS_PERIOD : SLEEP_CHECK_LEVELS_PERIOD;
+	return(mGovernor ? mGovernor->ScalePeriod(period) : period);
+}
+
 /***************************** PutDisplayToSleep ******************************/
 /*
 *	Puts the display to sleep.
@@ -1513,7 +1924,10 @@ void LTESensor::PutDisplayToSleep(void)
 		mDisplay->Fill();
 		mDisplay->Sleep();
 		mSleepLevel = eLightSleep;
-		SIM7000::SetCheckLevelsPeriod(30000);	// every 30 seconds
+		SIM7000::SetCheckLevelsPeriod(CheckLevelsPeriod(false));
+	#ifdef SUPPORT_GNSS
+		mGNSSFixWanted = false;
+	#endif
 	}
 }
 
@@ -1529,6 +1943,9 @@ void LTESensor::GoToDeepSleep(void)
 	mTimeIsValid = false;
 	PutDisplayToSleep();
 	SIM7000::Sleep();
+#ifdef SUPPORT_GNSS
+	mGNSSPowerRequested = false;	// The GNSS engine is off when the SIM7000 sleeps
+#endif
 	mSleepLevel = eEnteringDeepSleep;
 }
 
@@ -1567,6 +1984,12 @@ void LTESensor::DeepSleep(void)
 	set_sleep_mode(SLEEP_MODE_IDLE);
 	UnixTime::SetTime(0);
 	ATmega644RTC::RTCEnable();
+	mThermometers->ResetTrend();	// The time asleep is unknown
+	if (mGovernor)
+	{
+		mGovernor->Restart();
+	}
+	mLatency.Cancel();	// millis() doesn't advance in deep sleep
 }
 
 #ifdef SUPPORT_PERIODIC_SLEEP
@@ -1678,6 +2101,10 @@ void LTESensor::MessageRead(
 	*						- the current signal strength in bars, a number from
 	*						  1 to 5 (if 0 a message couldn't be sent/received.)
 	*						- the battery level as a percentage from 1 to 100.
+	*		- Hist		Will report to target the minimum, maximum and mean of
+	*					each sensor over the history (~13 hours.)
+	*		- Lat		Will report to target the latency of the alarm SMSs
+	*					by stage, from the thermometer reading to the SMSC.
 	*
 	*/
 
@@ -1723,6 +2150,26 @@ void LTESensor::MessageRead(
 							const char*	tokenPtr = &token[1];
 							thisChar = GetInt16Value(tokenPtr, alarmTemp);
 							/*
+							*	h<index>:<value> and l<index>:<value> set the
+							*	limit of a single thermometer.  h<value> and
+							*	l<value> set the limit of all thermometers,
+							*	replacing any per thermometer limit.  A token
+							*	with an index out of range is ignored.
+							*/
+							uint8_t	index = 0xFF;
+							if (thisChar == ':')
+							{
+								if (alarmTemp < 0 ||
+									alarmTemp >= mThermometers->GetCount())
+								{
+									messagePtr += tokenLen;
+									continue;
+								}
+								index = alarmTemp;
+								tokenPtr++;
+								thisChar = GetInt16Value(tokenPtr, alarmTemp);
+							}
+							/*
 							*	The alarm high/low values are fixed-point with a
 							*	1/16 scale. (low 4 bits used for fraction.)  The
 							*	value read has no fractional component.  For this
@@ -1753,14 +2200,26 @@ void LTESensor::MessageRead(
 							// The value read isn't sanity checked because the
 							// response to this command is to echo the values set
 							// back to the sender.
-							if (token[0] == 'h')
+							if (index != 0xFF)
+							{
+								// The limit is saved with the thermometer's ROM.
+								if (token[0] == 'h')
+								{
+									mThermometers->SetAlarmHigh(index, alarmTemp);
+								} else
+								{
+									mThermometers->SetAlarmLow(index, alarmTemp);
+								}
+							} else if (token[0] == 'h')
 							{
 								EEPROM.put(Config::kAlarmHighAddr, alarmTemp);
 								mThermometers->SetAlarmHigh(alarmTemp);
+								mThermometers->ClearAlarmLimits(true, false);
 							} else
 							{
 								EEPROM.put(Config::kAlarmLowAddr, alarmTemp);
 								mThermometers->SetAlarmLow(alarmTemp);
+								mThermometers->ClearAlarmLimits(false, true);
 							}
 							//char alarmTempStr[10];
 							//Fixed16ToDec10Str(alarmTemp, alarmTempStr);
@@ -1789,6 +2248,19 @@ void LTESensor::MessageRead(
 					QueueSMSReply(eQueryReply);
 				}
 				break;
+			case eHistoryCmd:
+				if (mHistory &&
+					SameAddress(mTargetAddr, inSender))
+				{
+					QueueSMSReply(eHistoryReply);
+				}
+				break;
+			case eLatencyCmd:
+				if (SameAddress(mTargetAddr, inSender))
+				{
+					QueueSMSReply(eLatencyReply);
+				}
+				break;
 		}
 	}
 }
@@ -1807,14 +2279,29 @@ void LTESensor::DoOnOffCmd(
 *	is supported.  There are assumptions in this class that there is only ever
 *	one SMS being sent at a time.  If a queue is implemented these assumptions
 *	need to be removed.
+*
+*	Non-urgent replies wait up to mSMSDeferPeriod for a favorable signal.
+*	Alarm replies are sent immediately and get more retries.  An alarm reply
+*	takes the place of a pending (deferred or retrying) non-urgent reply.  The
+*	displaced reply is requeued after the alarm has been sent.
 */
 bool LTESensor::QueueSMSReply(
 	uint8_t	inReply)
 {
 	bool	queued = mSMSReply == eNoReply;
+	if (!queued &&
+		inReply >= eAlarmReply &&
+		mSMSReply < eAlarmReply)
+	{
+		mDisplacedSMSReply = mSMSReply;
+		queued = true;
+	}
 	if (queued)
 	{
 		mSMSReply = inReply;
+		mSMSRetries = inReply >= eAlarmReply ? ALARM_SMS_RETRIES : 1;
+		mSMSRetryPeriod.Set(0);
+		mSMSDeferPeriod.Start();
 	}
 	return(queued);
 }
@@ -1822,21 +2309,79 @@ bool LTESensor::QueueSMSReply(
 /*************************** ProcessQueuedSMSReply ****************************/
 void LTESensor::ProcessQueuedSMSReply(void)
 {
-	if (mSMSReply != eNoReply &&
-		DoQueryCmdReply(mSMSReply == eQueryReplyWithOK))
+	if (mSMSReply != eNoReply)
 	{
-		mSMSReply = eNoReply;
+		if (mSMSRetryPeriod.Get())
+		{
+			if (!mSMSRetryPeriod.Passed())
+			{
+				return;
+			}
+			mSMSRetryPeriod.Set(0);
+		} else if (mSMSReply < eAlarmReply &&
+			!SignalIsFavorable() &&
+			!mSMSDeferPeriod.Passed())
+		{
+			return;
+		}
+		bool	sent;
+		switch (mSMSReply)
+		{
+			case eHistoryReply:
+				sent = DoHistoryCmdReply();
+				break;
+			case eTrendAlarmReply:
+				sent = DoTrendAlarmReply();
+				break;
+			case eLatencyReply:
+				sent = DoLatencyReply();
+				break;
+			default:
+				sent = DoQueryCmdReply(mSMSReply == eQueryReplyWithOK);
+				break;
+		}
+		if (sent)
+		{
+			mSentSMSReply = mSMSReply;
+			mSMSReply = eNoReply;
+		}
 	}
 }
 	
+/********************************* FitsInSMS **********************************/
+/*
+*	Replies are limited to a single SMS.  If the line from inLineStart to
+*	ioReplyPtr plus inReserve characters to follow doesn't fit, the line is
+*	removed.
+*/
+bool LTESensor::FitsInSMS(
+	const char*	inReplyStr,
+	char*&		ioReplyPtr,
+	char*		inLineStart,
+	uint8_t		inReserve)
+{
+	bool	fits = (ioReplyPtr - inReplyStr) + inReserve <= SIM7000::kMaxSMSLength;
+	if (!fits)
+	{
+		ioReplyPtr = inLineStart;
+		*ioReplyPtr = 0;
+	}
+	return(fits);
+}
+
 /****************************** DoQueryCmdReply *******************************/
 /*
 *	Alarm is ON, High 90F, Low 40F
 *	Sensors: (* = alarm)
 *	  0: 90.5F *
-*	  1: 80.2F
+*	  1: 80.2F h95F l40F	(Only if the sensor has its own limits)
 *	Signal: 3.8 (5 = best)
 *	Battery: 84%
+*	Pos: 42.123456,-71.123456	(Only if there has been a GNSS fix)
+*
+*	The sensor and position lines are limited to what fits in one SMS.  The
+*	limits of a sensor are echoed in the setup command syntax so that the
+*	sender can check the values set.
 */
 bool LTESensor::DoQueryCmdReply(
 	bool	inPrependOK)
@@ -1844,7 +2389,7 @@ bool LTESensor::DoQueryCmdReply(
 	bool	sent = false;
 	if (ClearToSendSMS())
 	{
-		char replyStr[200];
+		char replyStr[240];
 		char*	replyPtr = replyStr;
 		if (inPrependOK)
 		{
@@ -1867,13 +2412,30 @@ bool LTESensor::DoQueryCmdReply(
 		replyPtr += (DS18B20Multidrop::CreateTempStr(mThermometers->GetAlarmLow(),
 											mTempIsCelsius, true, true, replyPtr) + 3);
 		replyPtr = strcpy_P(replyPtr, PSTR("\nSensors: (* = alarm)")) + 21;
-		// Sensors/Thermometers
+		// Sensors/Thermometers, as many as fit with the signal and battery
 		uint8_t	count = mThermometers->GetCount();
 		if (count > 5)count = 5;
 		for (uint8_t i = 0; i < count; i++)
 		{
+			char*	lineStart = replyPtr;
 			*(replyPtr++) = '\n';
 			replyPtr = CreateIndexedTempStr(i, true, true, replyPtr);
+			int16_t	alarmHigh = mThermometers->GetAlarmHigh(i);
+			int16_t	alarmLow = mThermometers->GetAlarmLow(i);
+			if (alarmHigh != mThermometers->GetAlarmHigh() ||
+				alarmLow != mThermometers->GetAlarmLow())
+			{
+				replyPtr = strcpy_P(replyPtr, PSTR(" h")) + 2;
+				replyPtr += (DS18B20Multidrop::CreateTempStr(alarmHigh,
+											mTempIsCelsius, true, true, replyPtr) + 3);
+				replyPtr = strcpy_P(replyPtr, PSTR(" l")) + 2;
+				replyPtr += (DS18B20Multidrop::CreateTempStr(alarmLow,
+											mTempIsCelsius, true, true, replyPtr) + 3);
+			}
+			if (!FitsInSMS(replyStr, replyPtr, lineStart, kQueryTailLength))
+			{
+				break;
+			}
 		}
 		// Signal Strength
 		replyPtr = strcpy_P(replyPtr, PSTR("\nSignal: ")) + 9;
@@ -1894,7 +2456,18 @@ bool LTESensor::DoQueryCmdReply(
 			replyPtr[0] = (batteryLevel % 10) + '0';
 			replyPtr[1] = '%';
 			replyPtr[2] = 0;
+			replyPtr += 2;
 		}
+	#ifdef SUPPORT_GNSS
+		// Last GNSS fix, if any
+		if (mGNSS.HasFix())
+		{
+			char*	lineStart = replyPtr;
+			replyPtr = strcpy_P(replyPtr, PSTR("\nPos: ")) + 6;
+			replyPtr = mGNSS.CreatePositionStr(replyPtr);
+			FitsInSMS(replyStr, replyPtr, lineStart);
+		}
+	#endif
 	#if 1
 		sent = SendSMS(mTargetAddr, replyStr);
 	#else
@@ -1906,6 +2479,230 @@ bool LTESensor::DoQueryCmdReply(
 	return(sent);
 }
 
+/***************************** DoHistoryCmdReply ******************************/
+bool LTESensor::DoHistoryCmdReply(void)
+{
+	bool	sent = false;
+	if (ClearToSendSMS())
+	{
+		char replyStr[240];
+		CreateHistoryStr(replyStr);
+		sent = SendSMS(mTargetAddr, replyStr);
+	}
+	return(sent);
+}
+
+/***************************** DoTrendAlarmReply ******************************/
+/*
+*	Trend alarm: (rate, limit reached in)
+*	 0: 30.5F, 3.6F/h, high in 40 min
+*
+*	Sensor lines that don't fit in one SMS are left off.
+*/
+bool LTESensor::DoTrendAlarmReply(void)
+{
+	bool	sent = false;
+	if (ClearToSendSMS())
+	{
+		char replyStr[240];
+		char*	replyPtr = strcpy_P(replyStr, PSTR("Trend alarm: (rate, limit reached in)")) + 37;
+		uint8_t	lines = 0;
+		for (uint8_t i = 0; i < mThermometers->GetCount() && lines < 5; i++)
+		{
+			if (!mThermometers->TrendAlarm(i))
+			{
+				continue;
+			}
+			char*	lineStart = replyPtr;
+			*(replyPtr++) = '\n';
+			replyPtr = CreateIndexedTempStr(i, false, true, replyPtr);
+			*(replyPtr++) = ',';
+			*(replyPtr++) = ' ';
+			int16_t	slope = mThermometers->GetSlope(i);
+			bool	rising = slope > 0;
+			if (!mTempIsCelsius)
+			{
+				slope = DS18B20Multidrop::CToFDelta(slope);
+			}
+			replyPtr += (DS18B20Multidrop::CreateTempStr(slope, true, false,
+															true, replyPtr) + 2);
+			replyPtr[0] = mTempIsCelsius ? 'C':'F';
+			replyPtr[1] = '/';
+			replyPtr[2] = 'h';
+			replyPtr[3] = ',';
+			replyPtr[4] = ' ';
+			replyPtr += 5;
+			replyPtr = strcpy_P(replyPtr, rising ? PSTR("high in ") : PSTR("low in "));
+			replyPtr += strlen(replyPtr);
+			Uint16ToDecStr(mThermometers->GetTimeToAlarm(i), replyPtr);
+			replyPtr += strlen(replyPtr);
+			replyPtr = strcpy_P(replyPtr, PSTR(" min")) + 4;
+			if (!FitsInSMS(replyStr, replyPtr, lineStart))
+			{
+				break;
+			}
+			lines++;
+		}
+		*replyPtr = 0;
+		sent = SendSMS(mTargetAddr, replyStr);
+	}
+	return(sent);
+}
+
+/******************************* DoLatencyReply *******************************/
+/*
+*	Alarm latency: 3 (last, max s)
+*	Total 13.6, 28.0
+*	Confirm 10.2, 20.4
+*	Detect 0.0, 0.0
+*	Queue 0.0, 2.3
+*	Prompt 0.1, 0.2
+*	Accept 3.2, 5.1
+*	Hist <16.4:1 <32.8:2
+*
+*	Hist is the histogram of the total.  Whatever doesn't fit in one SMS is
+*	left off.
+*/
+bool LTESensor::DoLatencyReply(void)
+{
+	bool	sent = false;
+	if (ClearToSendSMS())
+	{
+		char replyStr[240];
+		char*	replyPtr = strcpy_P(replyStr, PSTR("Alarm latency: ")) + 15;
+		Uint16ToDecStr(mLatency.Count(), replyPtr);
+		replyPtr += strlen(replyPtr);
+		if (mLatency.Count())
+		{
+			replyPtr = strcpy_P(replyPtr, PSTR(" (last, max s)")) + 14;
+			bool	fits = true;
+			// The total first, followed by the stages in order
+			for (uint8_t i = 0; fits && i < AlarmLatency::eStages; i++)
+			{
+				uint8_t	stage = i ? i - 1 : AlarmLatency::eTotalStage;
+				char*	lineStart = replyPtr;
+				*(replyPtr++) = '\n';
+				replyPtr = strcpy_P(replyPtr, (const char*)AlarmLatency::GetStageStr(stage));
+				replyPtr += strlen(replyPtr);
+				*(replyPtr++) = ' ';
+				replyPtr = CreateSecondsStr(mLatency.Last(stage), replyPtr);
+				*(replyPtr++) = ',';
+				*(replyPtr++) = ' ';
+				replyPtr = CreateSecondsStr(mLatency.Max(stage), replyPtr);
+				fits = FitsInSMS(replyStr, replyPtr, lineStart);
+			}
+			if (fits)
+			{
+				char*	lineStart = replyPtr;
+				replyPtr = strcpy_P(replyPtr, PSTR("\nHist")) + 5;
+				fits = FitsInSMS(replyStr, replyPtr, lineStart);
+			}
+			for (uint8_t bucket = 0; fits && bucket < AlarmLatency::kBuckets; bucket++)
+			{
+				uint8_t	count = mLatency.BucketCount(AlarmLatency::eTotalStage, bucket);
+				if (count)
+				{
+					char*	itemStart = replyPtr;
+					bool	isLast = bucket == (AlarmLatency::kBuckets - 1);
+					*(replyPtr++) = ' ';
+					*(replyPtr++) = isLast ? '>' : '<';
+					replyPtr = CreateSecondsStr(AlarmLatency::BucketLimit(
+										isLast ? bucket - 1 : bucket), replyPtr);
+					*(replyPtr++) = ':';
+					Uint16ToDecStr(count, replyPtr);
+					replyPtr += strlen(replyPtr);
+					fits = FitsInSMS(replyStr, replyPtr, itemStart);
+				}
+			}
+		}
+		*replyPtr = 0;
+		sent = SendSMS(mTargetAddr, replyStr);
+	}
+	return(sent);
+}
+
+/****************************** CreateSecondsStr ******************************/
+/*
+*	Seconds to one decimal place, e.g. 12.3.  Returns the end of the string.
+*/
+char* LTESensor::CreateSecondsStr(
+	uint32_t	inMS,
+	char*		outStr)
+{
+	uint32_t	tenths = (inMS + 50) / 100;
+	if (tenths > 65535)
+	{
+		tenths = 65535;
+	}
+	Uint16ToDecStr(tenths / 10, outStr);
+	outStr += strlen(outStr);
+	outStr[0] = '.';
+	outStr[1] = (tenths % 10) + '0';
+	outStr[2] = 0;
+	return(outStr + 2);
+}
+
+/****************************** CreateHistoryStr ******************************/
+/*
+*	History: (min to max, mean, hours)
+*	 0: 12.5F to 18.0F, 15.5F, 13.5h
+*
+*	Sensor lines that don't fit in one SMS are left off.  outStr must have
+*	room for one line more than SIM7000::kMaxSMSLength.
+*	Returns a pointer to the nul terminator.
+*/
+char* LTESensor::CreateHistoryStr(
+	char*	outStr)
+{
+	const char*	startStr = outStr;
+	outStr = strcpy_P(outStr, PSTR("History: (min to max, mean, hours)")) + 34;
+	uint8_t	count = mHistory->GetCount();
+	if (count > 5)count = 5;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		STempHistorySummary	summary;
+		if (mHistory->GetSummary(i, summary))
+		{
+			char*	lineStart = outStr;
+			*(outStr++) = '\n';
+			*(outStr++) = ' ';
+			if (i > 9)
+			{
+				*(outStr++) = (i / 10) + '0';	// Assumes i 0 to 99
+			}
+			outStr[0] = (i % 10) + '0';
+			outStr[1] = ':';
+			outStr[2] = ' ';
+			outStr+=3;
+			outStr += (DS18B20Multidrop::CreateTempStr(summary.min,
+											mTempIsCelsius, true, true, outStr) + 3);
+			outStr = strcpy_P(outStr, PSTR(" to ")) + 4;
+			outStr += (DS18B20Multidrop::CreateTempStr(summary.max,
+											mTempIsCelsius, true, true, outStr) + 3);
+			*(outStr++) = ',';
+			*(outStr++) = ' ';
+			outStr += (DS18B20Multidrop::CreateTempStr(summary.mean,
+											mTempIsCelsius, true, true, outStr) + 3);
+			*(outStr++) = ',';
+			*(outStr++) = ' ';
+			uint16_t	tenths = ((uint32_t)summary.samples * mHistory->WindowPeriod()) / 360000;
+			Uint16ToDecStr(tenths / 10, outStr);
+			outStr += strlen(outStr);
+			outStr[0] = '.';
+			outStr[1] = (tenths % 10) + '0';
+			outStr[2] = 'h';
+			outStr[3] = 0;
+			outStr += 3;
+			if (!FitsInSMS(startStr, outStr, lineStart))
+			{
+				break;
+			}
+		}
+	}
+	*outStr = 0;
+	return(outStr);
+}
+
 /**************************** HandleNoSIMCardFound ****************************/
 void LTESensor::HandleNoSIMCardFound(void)
 {
@@ -1913,6 +2710,24 @@ void LTESensor::HandleNoSIMCardFound(void)
 				eNoMessage, eSettingsMode, eAlarmStateItem);
 }
 
+#ifdef SUPPORT_GNSS
+/******************************* HandleGNSSInfo *******************************/
+/*
+*	Called by SIM7000::ParseCommandResponse for +CGNSINF responses.
+*	If the response shows the GNSS engine isn't running then it will be turned
+*	on at the next poll.  A fix ends polling till the display wakes.
+*/
+void LTESensor::HandleGNSSInfo(
+	const char*	inParams)
+{
+	if (mGNSS.Parse(inParams))
+	{
+		mGNSSFixWanted = false;
+	}
+	mGNSSPowerRequested = mGNSS.IsRunning();
+}
+#endif
+
 #ifdef SUPPORT_PERIODIC_SLEEP
 /******************************** watchdog ************************************/
 /*
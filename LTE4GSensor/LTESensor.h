@@ -30,8 +30,15 @@
 #include "DisplayController.h"
 #include "SIM7000.h"
 #include "PINEditor.h"
+#include "AlarmLatency.h"
+#ifdef SUPPORT_GNSS
+#include "GNSSParser.h"
+#endif
 
 class DS18B20Multidrop;
+class TempHistory;
+class SensorScheduler;
+class PowerGovernor;
 
 class LTESensor : public XFont, public SIM7000
 {
@@ -44,6 +51,19 @@ public:
 								Font*					inSmallFont);
 		
 	void					GiveTime(void);
+							// Optional, must be set before begin()
+	void					SetHistory(
+								TempHistory*			inHistory)
+								{mHistory = inHistory;}
+							// Optional, when set the thermometers must be
+							// one of the scheduler's sensors.
+	void					SetScheduler(
+								SensorScheduler*		inScheduler)
+								{mScheduler = inScheduler;}
+							// Optional, must be set after the governor's begin()
+	void					SetPowerGovernor(
+								PowerGovernor*			inGovernor)
+								{mGovernor = inGovernor;}
 	static void				SetButtonPressed(
 								bool					inButtonPressed)
 								{sButtonPressed = sButtonPressed || inButtonPressed;}
@@ -52,7 +72,11 @@ public:
 
 protected:
 	PINEditor				mPINEditor;
+	AlarmLatency			mLatency;
 	DS18B20Multidrop*		mThermometers;
+	TempHistory*			mHistory;
+	SensorScheduler*		mScheduler;
+	PowerGovernor*			mGovernor;
 	Font*					mNormalFont;
 	Font*					mSmallFont;
 	Rect8_t					mSelectionRect;
@@ -63,6 +87,15 @@ protected:
 #endif
 	MSPeriod				mDebouncePeriod;	// For buttons and SD card
 	MSPeriod				mSelectionPeriod;	// Selection frame flash rate
+	MSPeriod				mSMSDeferPeriod;	// Max wait for a favorable signal
+	MSPeriod				mSMSRetryPeriod;	// Delay before resending a failed SMS
+	uint32_t				mMaxThermometerUpdateTime;	// us, see 'T' serial command
+#ifdef SUPPORT_GNSS
+	GNSSParser				mGNSS;
+	MSPeriod				mGNSSPeriod;
+	bool					mGNSSPowerRequested;
+	bool					mGNSSFixWanted;	// Till a fix is taken or the display sleeps
+#endif
 	
 	TPAddress				mTargetAddr;
 	uint16_t				mPIN;	// Initialized from EEPROM 
@@ -76,6 +109,9 @@ protected:
 	uint8_t					mPrevBars;
 	uint8_t					mPrevConnectionStatus;
 	uint8_t					mSMSReply;
+	uint8_t					mSentSMSReply;	// Reply type being sent, for retries
+	uint8_t					mDisplacedSMSReply;	// Requeued after the alarm
+	uint8_t					mSMSRetries;
 	bool					mIgnoreButtonPress;
 	bool					mSleepEnabled;
 	//bool					mPrevSleepEnabled;
@@ -87,6 +123,7 @@ protected:
 	bool					mPrevAlarmIsOn;
 	bool					mPrevTimeIsValid;
 	bool					mWaitingToTurnAlarmOff;
+	bool					mTrendAlarmSent;	// Queued for the current trend alarm
 	bool					mTextMessageProcessingEnabled;
 	uint8_t					mPrevBatteryLevel;
 	uint8_t					mSelectionIndex;
@@ -110,10 +147,27 @@ protected:
 								uint8_t					inReply);
 	virtual void			ProcessQueuedSMSReply(void);
 	virtual void			HandleNoSIMCardFound(void);
+#ifdef SUPPORT_GNSS
+	void					HandleGNSSInfo(
+								const char*				inParams);
+#endif
 	void					DoOnOffCmd(
 								bool					inAlarmIsOn);
 	bool					DoQueryCmdReply(
 								bool					inPrependOK);
+	bool					DoHistoryCmdReply(void);
+	bool					DoTrendAlarmReply(void);
+	static bool				FitsInSMS(
+								const char*				inReplyStr,
+								char*&					ioReplyPtr,
+								char*					inLineStart,
+								uint8_t					inReserve = 0);
+	bool					DoLatencyReply(void);
+	static char*			CreateSecondsStr(
+								uint32_t				inMS,
+								char*					outStr);
+	char*					CreateHistoryStr(
+								char*					outStr);
 	
 	void					UpdateActions(void);
 	void					UpdateDisplay(void);
@@ -134,6 +188,8 @@ protected:
 	void					WakeUpDisplay(void);
 	void					WakeUpSIM7000(void);
 	void					PutDisplayToSleep(void);
+	uint32_t				CheckLevelsPeriod(
+								bool					inDisplayIsAwake) const;
 	void					GoToDeepSleep(void);
 	void					DeepSleep(void);
 
@@ -210,7 +266,11 @@ protected:
 	{
 		eNoReply,
 		eQueryReply,
-		eQueryReplyWithOK
+		eQueryReplyWithOK,
+		eHistoryReply,
+		eLatencyReply,
+		eAlarmReply,		// This and following sent immediately regardless of the signal
+		eTrendAlarmReply
 	};
 	enum EMode
 	{
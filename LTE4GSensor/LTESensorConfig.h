@@ -34,6 +34,16 @@
 #define CHECK_TEMP_TICKS	60*1000		// 1 minute in ms 
 #define CHECK_FOR_SMS_TICKS	5*60*1000	// 5 minutes in ms
 #endif
+#define SMS_DEFER_PERIOD	30000	// ms a non-urgent SMS waits for a better signal
+#define SMS_RETRY_PERIOD	2000	// ms before a failed alarm SMS is resent
+#define ALARM_SMS_RETRIES	3
+#define AWAKE_CHECK_LEVELS_PERIOD	10000	// ms, display awake
+#define SLEEP_CHECK_LEVELS_PERIOD	30000	// ms, display asleep
+
+//#define SUPPORT_GNSS	1	// Report the position, the GNSS engine costs battery
+#ifdef SUPPORT_GNSS
+#define GNSS_POLL_PERIOD	60000	// ms between GNSS fix requests
+#endif
 // Anything higher than 19200 on a 8MHz mcu will have problems when 2 UARTs are
 // operating at the same time.
 #define BAUD_RATE	19200
@@ -115,6 +125,9 @@ namespace Config
 	*	[22 to 29] unused/available
 	*	[30]	int16_t		Alarm High (C)
 	*	[32]	int16_t		Alarm Low (C)
+	*	[34]	uint8_t		Thermometer ROM cache and per thermometer alarm
+	*						limits, 1 + 13 bytes per thermometer,
+	*						see DS18B20Multidrop::SetROMCache (53 bytes for 4)
 	*/
 	const uint16_t	kFlagsAddr	= 0;
 	const uint8_t	k12HourClockBit		= 0;
@@ -126,6 +139,7 @@ namespace Config
 	const uint16_t	kTargetAddr			= 6;
 	const uint16_t	kAlarmHighAddr		= 30;
 	const uint16_t	kAlarmLowAddr		= 32;
+	const uint16_t	kROMCacheAddr		= 34;
 
 	const uint8_t	kTextInset			= 3; // Makes room for drawing the selection frame
 	const uint8_t	kTextVOffset		= 6; // Makes room for drawing the selection frame
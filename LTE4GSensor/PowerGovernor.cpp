@@ -0,0 +1,239 @@
+/*
+*	PowerGovernor.cpp, Copyright (c) 2022 Jonathan Mackey
+*	Scales the polling periods by the battery level and discharge rate.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include <Arduino.h>
+#include "PowerGovernor.h"
+#include "DS18B20Multidrop.h"
+#include "UnixTime.h"
+
+/******************************* PowerGovernor ********************************/
+PowerGovernor::PowerGovernor(
+	uint32_t	inAlarmLatencyLimit,
+	uint16_t	inTargetRuntime)
+	: mThermometers(nullptr), mEvaluatePeriod(kEvaluatePeriod),
+	  mAlarmLatencyLimit(inAlarmLatencyLimit), mBaseUpdatePeriod(0),
+	  mBaseSleepDelay(0), mThermometerPeriod(0), mLevelTime(0),
+	  mTargetRuntime(inTargetRuntime), mRate(0), mLevel(0),
+	  mPolicy(eNormalPolicy), mRuntimeStep(false), mLevelTimed(false)
+{
+}
+
+/*********************************** begin ************************************/
+void PowerGovernor::begin(
+	DS18B20Multidrop*	inThermometers)
+{
+	mThermometers = inThermometers;
+	mBaseUpdatePeriod = inThermometers->GetUpdatePeriod();
+	mThermometerPeriod = mBaseUpdatePeriod;
+	mBaseSleepDelay = UnixTime::SleepDelay();
+	mEvaluatePeriod.Start();
+}
+
+/*********************************** Update ***********************************/
+/*
+*	The battery percentage is derived from the voltage so it can bounce back
+*	up by 1%.  Only drops are timed, from the previous timed drop, and a rise
+*	of more than 1% is taken as charging (or a fresh battery.)
+*
+*	The policy is evaluated when the level changes and every kEvaluatePeriod
+*	(the rate estimate decays while the level holds.)
+*/
+bool PowerGovernor::Update(
+	uint8_t	inBatteryLevel)
+{
+	bool	evaluate = mEvaluatePeriod.Passed();
+	if (inBatteryLevel &&
+		inBatteryLevel != mLevel)
+	{
+		uint32_t	now = millis();
+		if (inBatteryLevel < mLevel ||
+			mLevel == 0)
+		{
+			if (mLevelTimed)
+			{
+				uint32_t	minutes = (now - mLevelTime) / 60000;
+				if (minutes == 0)
+				{
+					minutes = 1;
+				}
+				uint32_t	sample = ((uint32_t)(mLevel - inBatteryLevel) * 16 * 60) / minutes;
+				if (sample > 0xFFFF)
+				{
+					sample = 0xFFFF;
+				}
+				mRate = mRate ? mRate + ((int32_t)sample - mRate) / 4 : sample;
+			}
+			mLevelTimed = mLevel != 0;
+			mLevel = inBatteryLevel;
+			mLevelTime = now;
+			evaluate = true;
+		} else if (inBatteryLevel > mLevel + 1)
+		{
+			mRate = 0;
+			mLevelTimed = false;
+			mLevel = inBatteryLevel;
+			evaluate = true;
+		}
+	}
+	bool	changed = false;
+	if (evaluate &&
+		mThermometers)
+	{
+		mEvaluatePeriod.Start();
+		uint8_t	policy = ChoosePolicy();
+		uint32_t	period = mBaseUpdatePeriod << policy;
+		uint32_t	maxPeriod = mAlarmLatencyLimit > kConversionAllowance ?
+								(mAlarmLatencyLimit - kConversionAllowance) /
+									mThermometers->AlarmLatencyPeriods() : 1000;
+		if (period > maxPeriod)
+		{
+			period = maxPeriod;
+		}
+		if (policy != mPolicy ||
+			period != mThermometerPeriod)
+		{
+			mPolicy = policy;
+			mThermometerPeriod = period;
+			mThermometers->SetUpdatePeriod(period);
+			changed = true;
+		}
+	}
+	return(changed);
+}
+
+/********************************** Restart ***********************************/
+/*
+*	The time since the last drop is unknown, e.g. after deep sleep.
+*/
+void PowerGovernor::Restart(void)
+{
+	mLevelTimed = false;
+	mLevelTime = millis();
+}
+
+/******************************** LevelPolicy *********************************/
+/*
+*	To relax the policy the level has to be kLevelHysteresis above the
+*	threshold that stepped it so that a level bouncing by 1% doesn't toggle it.
+*/
+uint8_t PowerGovernor::LevelPolicy(void) const
+{
+	uint8_t	policy = eNormalPolicy;
+	if (mLevel)
+	{
+		uint8_t	saverLevel = kSaverLevel;
+		uint8_t	criticalLevel = kCriticalLevel;
+		if (mPolicy >= eSaverPolicy)
+		{
+			saverLevel += kLevelHysteresis;
+		}
+		if (mPolicy >= eCriticalPolicy)
+		{
+			criticalLevel += kLevelHysteresis;
+		}
+		if (mLevel <= criticalLevel)
+		{
+			policy = eCriticalPolicy;
+		} else if (mLevel <= saverLevel)
+		{
+			policy = eSaverPolicy;
+		}
+	}
+	return(policy);
+}
+
+/******************************** ChoosePolicy ********************************/
+/*
+*	When the projected runtime is less than the target the policy is stepped
+*	once more.  The step saves power so the projection rises.  It's only
+*	removed when the projection exceeds the target by half again.
+*/
+uint8_t PowerGovernor::ChoosePolicy(void)
+{
+	uint8_t	policy = LevelPolicy();
+	if (mTargetRuntime)
+	{
+		uint16_t	runtime = ProjectedRuntime();
+		if (runtime != kUnknownRuntime)
+		{
+			if (runtime < mTargetRuntime)
+			{
+				mRuntimeStep = true;
+			} else if (runtime > mTargetRuntime + mTargetRuntime/2)
+			{
+				mRuntimeStep = false;
+			}
+		}
+		if (mRuntimeStep &&
+			policy < eCriticalPolicy)
+		{
+			policy++;
+		}
+	}
+	return(policy);
+}
+
+/******************************** SleepDelay **********************************/
+uint32_t PowerGovernor::SleepDelay(void) const
+{
+	uint32_t	delay = mBaseSleepDelay >> mPolicy;
+	uint32_t	minDelay = mBaseSleepDelay < kMinSleepDelay ?
+							mBaseSleepDelay : kMinSleepDelay;
+	return(delay < minDelay ? minDelay : delay);
+}
+
+/******************************* DischargeRate ********************************/
+/*
+*	While the level holds the rate can't be more than 1% per the time held.
+*/
+uint16_t PowerGovernor::DischargeRate(void) const
+{
+	uint16_t	rate = mRate;
+	uint32_t	minutes = (millis() - mLevelTime) / 60000;
+	if (rate &&
+		minutes)
+	{
+		uint32_t	maxRate = (16 * 60) / minutes;
+		if (maxRate == 0)
+		{
+			maxRate = 1;
+		}
+		if (rate > maxRate)
+		{
+			rate = maxRate;
+		}
+	}
+	return(rate);
+}
+
+/****************************** ProjectedRuntime ******************************/
+uint16_t PowerGovernor::ProjectedRuntime(void) const
+{
+	uint16_t	runtime = kUnknownRuntime;
+	uint16_t	rate = DischargeRate();
+	if (rate)
+	{
+		uint32_t	hours = ((uint32_t)mLevel * 16) / rate;
+		runtime = hours < kUnknownRuntime ? hours : kUnknownRuntime - 1;
+	}
+	return(runtime);
+}
@@ -0,0 +1,110 @@
+/*
+*	PowerGovernor.h, Copyright (c) 2022 Jonathan Mackey
+*	Scales the polling periods by the battery level and discharge rate.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef PowerGovernor_h
+#define PowerGovernor_h
+
+#include <inttypes.h>
+#include "MSPeriod.h"
+
+class DS18B20Multidrop;
+
+/*
+*	The policy doubles the thermometer update and modem levels check periods,
+*	and halves the display sleep delay, for each step from normal.  The
+*	policy steps down (saves more) when the battery level falls below the
+*	saver and critical levels, and when the projected runtime is less than
+*	the target runtime.
+*
+*	The thermometer update period is capped so that the worst case time from
+*	a thermometer crossing a limit to its alarm being raised never exceeds
+*	the alarm latency limit, whatever the policy (see AlarmLatencyPeriods.)
+*
+*	The discharge rate is estimated from the +CBC battery percentage.  It's
+*	an EWMA of the time between 1% drops.  millis() doesn't advance in deep
+*	sleep so Restart() should be called on waking from it.
+*/
+class PowerGovernor
+{
+public:
+	enum EPolicy
+	{
+		eNormalPolicy,
+		eSaverPolicy,
+		eCriticalPolicy
+	};
+							PowerGovernor(
+								uint32_t				inAlarmLatencyLimit,	// ms
+								uint16_t				inTargetRuntime = 0);	// hours, 0 = none
+							// Captures the base update period and display
+							// sleep delay.  Call after the thermometers begin().
+	void					begin(
+								DS18B20Multidrop*		inThermometers);
+	/*
+	*	Called regularly with the battery level (%, 0 = unknown.)  Returns true
+	*	when the policy or thermometer update period changed, in which case
+	*	the thermometer update period has been set and the caller should
+	*	reapply the modem and display periods (ScalePeriod, SleepDelay.)
+	*/
+	bool					Update(
+								uint8_t					inBatteryLevel);
+	void					Restart(void);
+	uint8_t					Policy(void) const
+								{return(mPolicy);}
+	uint32_t				ScalePeriod(
+								uint32_t				inPeriod) const
+								{return(inPeriod << mPolicy);}
+							// Display sleep delay in seconds
+	uint32_t				SleepDelay(void) const;
+	uint32_t				ThermometerPeriod(void) const
+								{return(mThermometerPeriod);}
+							// 1/16 % per hour, 0 = unknown
+	uint16_t				DischargeRate(void) const;
+							// Hours, kUnknownRuntime if the rate is unknown
+	uint16_t				ProjectedRuntime(void) const;
+	static const uint16_t	kUnknownRuntime = 0xFFFF;
+protected:
+	DS18B20Multidrop*	mThermometers;
+	MSPeriod	mEvaluatePeriod;
+	uint32_t	mAlarmLatencyLimit;
+	uint32_t	mBaseUpdatePeriod;
+	uint32_t	mBaseSleepDelay;
+	uint32_t	mThermometerPeriod;
+	uint32_t	mLevelTime;			// millis() when mLevel was entered
+	uint16_t	mTargetRuntime;
+	uint16_t	mRate;				// EWMA, 1/16 % per hour, 0 = unknown
+	uint8_t		mLevel;				// Most recent battery level, 0 = unknown
+	uint8_t		mPolicy;
+	bool		mRuntimeStep;		// The policy was stepped for the runtime
+	bool		mLevelTimed;		// mLevel was entered by a timed drop
+	static const uint8_t	kSaverLevel = 40;		// %
+	static const uint8_t	kCriticalLevel = 15;	// %
+	static const uint8_t	kLevelHysteresis = 5;	// %
+	static const uint32_t	kMinSleepDelay = 15;	// seconds
+	static const uint32_t	kEvaluatePeriod = 60000;	// ms
+	static const uint32_t	kConversionAllowance = 1000;	// ms
+
+	uint8_t					LevelPolicy(void) const;
+	uint8_t					ChoosePolicy(void);
+};
+
+#endif // PowerGovernor_h
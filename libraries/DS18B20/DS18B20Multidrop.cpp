@@ -22,60 +22,148 @@
 */
 #include "DS18B20Multidrop.h"
 #include "Arduino.h"
+#include <EEPROM.h>
 #include "OneWire.h"
+#include "OneWireAsync.h"
 #include "StringUtils.h"
 
 const char DS18B20Multidrop::kDegCelsiusStr[] PROGMEM = "°C";
 const char DS18B20Multidrop::kDegFahrenheitStr[] PROGMEM = "°F";
+const char DS18B20Multidrop::kFamilyChars[] PROGMEM = "GBC?";
 
 /****************************** DS18B20Multidrop ******************************/
 DS18B20Multidrop::DS18B20Multidrop(
-	OneWire&	inOneWire,
-	uint32_t	inUpdatePeriod,
-	int16_t		inAlarmHigh,
-	int16_t		inAlarmLow,
-	EResolution	inResolution)
-	: mOneWire(inOneWire), mResolution(inResolution), mCount(0), 
+	OneWire&		inOneWire,
+	uint32_t		inUpdatePeriod,
+	int16_t			inAlarmHigh,
+	int16_t			inAlarmLow,
+	EResolution		inResolution,
+	uint8_t			inCapacity,
+	OneWireDevAddr*	inAddress,
+	int16_t*		inTemp,
+	uint8_t*		inChangedBits,
+	uint8_t*		inAlarmBits,
+	uint8_t*		inValidBits,
+	uint8_t*		inTrendBits,
+	SDS18B20Info*	inInfo,
+	SDS18B20Filter*	inFilter)
+	: mBusCount(1), mConvertingBuses(0), mUpdatePeriod(inUpdatePeriod),
+		mAddress(inAddress), mTemp(inTemp),
+		mChangedBits(inChangedBits), mAlarmBits(inAlarmBits),
+		mValidBits(inValidBits), mTrendBits(inTrendBits), mInfo(inInfo),
+		mFilter(inFilter), mOversamples(1), mBurstRemaining(0),
+		mSampling(false), mBurstStartTime(0), mBurstTime(0),
+		mAsync(nullptr), mAsyncIndex(0xFF),
+		mMaxInterval(1), mSlopeThreshold(0), mNearThreshold(0),
+		mSkippedReads(0), mSkippedConversions(0),
 		mAlarmHigh(inAlarmHigh), mAlarmLow(inAlarmLow),
-		mTemperatureChanged(false), mUpdatePeriod(inUpdatePeriod)
+		mAlarm(false), mTemperatureChanged(false), mDataIsValid(false),
+		mParasitePower(false), mParasiteBuses(0),
+		mAlarmLimitsChanged(false), mFullSweepCycles(0), mSweepCountdown(0),
+		mAlarmSearchHits(0), mSweepBusTime(0), mAlarmSearchBusTime(0),
+		mFullReadCycles(0), mFullReadCountdown(0), mFullRead(true),
+		mJumpThreshold(0), mTruncatedReads(0), mCRCFailures(0),
+		mROMCacheAddr(0), mAlarmHysteresis(0),
+		mAlarmConfirm(1), mAlarmLatch(false),
+		mDiscoveryBus(0xFF), mDiscoveryDue(false),
+		mRefreshing(false), mRefreshPending(false), mAlarmTraced(false),
+		mConversionStartTime(0), mAlarmTraceStart(0), mAlarmTraceRead(0),
+		mTrendHorizon(0), mTrendMinSlope(16),
+		mConversionTime(0), mMaxConversionTime(0),
+		mCount(0), mCapacity(inCapacity), mResolution(inResolution)
 {
+	ScaleTrendLimits();
+	mBus[0] = &inOneWire;
+	// Note that the storage belongs to the subclass and isn't constructed yet.
+}
+
+/*********************************** AddBus ***********************************/
+bool DS18B20Multidrop::AddBus(
+	OneWire&	inOneWire)
+{
+	bool	added = mBusCount < DS18B20_MAX_BUSES;
+	if (added)
+	{
+		mBus[mBusCount] = &inOneWire;
+		mBusCount++;
+	}
+	return(added);
 }
 
 /*********************************** begin ************************************/
+/*
+*	After the thermometer list is loaded from the ROM cache or found by
+*	searching, each thermometer is configured, fingerprinted and read (see
+*	Refresh.)  Fingerprinting measures the conversion time of each thermometer
+*	in turn so begin() takes up to ~800ms per thermometer.
+*/
 void DS18B20Multidrop::begin(void)
 {
+	if (mAsync)
+	{
+		mAsync->Abort();
+		mAsyncIndex = 0xFF;
+	}
+	memset(mInfo, 0, mCapacity * sizeof(SDS18B20Info));
+	memset(mFilter, 0, mCapacity * sizeof(SDS18B20Filter));
+	for (uint8_t i = 0; i < mCapacity; i++)
+	{
+		mInfo[i].alarmHigh = kNoAlarmLimit;
+		mInfo[i].alarmLow = kNoAlarmLimit;
+		mInfo[i].trendLevel = kNoTrend;
+	}
+	mCRCFailures = 0;
 	/*
-	*	Begin a targeted search for DS18B20 thermometers only.  Even if all of
-	*	the 1-Wire devices are DS18B20, a targeted search is faster.
+	*	initialize any garbage values in the thermometer arrays.
 	*/
-	mOneWire.target_search(0x28);
-	uint8_t tIndex = 0;
-	for(; tIndex < MAX_DS18B20_COUNT && mOneWire.search(mThermometer[tIndex].address);
-			tIndex++)
+	memset(mTemp, 0, mCapacity * sizeof(int16_t));
+	uint8_t	bitsetSize = BitsetSize(mCapacity);
+	memset(mChangedBits, 0, bitsetSize);
+	memset(mAlarmBits, 0, bitsetSize);
+	memset(mValidBits, 0, bitsetSize);
+	memset(mTrendBits, 0, bitsetSize);
+	mDataIsValid = false;
+	mSweepCountdown = 0;	// First update is a full sweep
+	mDiscoveryBus = 0xFF;
+	mCount = LoadROMCache();
+	if (mCount == 0)
 	{
-		if (OneWire::crc8(mThermometer[tIndex].address, 7) == mThermometer[tIndex].address[7])
+		/*
+		*	Begin a targeted search for DS18B20 thermometers only.  Even if all
+		*	of the 1-Wire devices are DS18B20, a targeted search is faster.
+		*/
+		uint8_t tIndex = 0;
+		for (uint8_t bus = 0; bus < mBusCount; bus++)
 		{
-		#ifdef DUMP_TO_SERIAL
-			Serial.print(F("ROM"));
-			for (uint8_t k = 0; k < 8; k++)
+			OneWire&	oneWire = *mBus[bus];
+			oneWire.target_search(0x28);
+			for(; tIndex < mCapacity && oneWire.search(mAddress[tIndex]);
+					tIndex++)
 			{
-				Serial.print(' ');
-				Serial.print(mThermometer[tIndex].address[k], HEX);
+				if (OneWire::crc8(mAddress[tIndex], 7) == mAddress[tIndex][7])
+				{
+					mInfo[tIndex].bus = bus;
+					mInfo[tIndex].interval = 1;
+				#ifdef DUMP_TO_SERIAL
+					Serial.print(F("ROM"));
+					for (uint8_t k = 0; k < 8; k++)
+					{
+						Serial.print(' ');
+						Serial.print(mAddress[tIndex][k], HEX);
+					}
+					Serial.println();
+				#endif
+					continue;
+				}
+				break;	// Error
 			}
-			Serial.println();
-		#endif
-			continue;
 		}
-		break;	// Error
+		mCount = tIndex;
+		SaveROMCache();
 	}
-	mCount = tIndex;
 	
 	if (mCount)
 	{
-		DSScratchPad	scratchPad;
-		scratchPad.f.alarmHigh = mAlarmHigh/16;
-		scratchPad.f.alarmLow = mAlarmLow/16;
-		scratchPad.f.config = (mResolution << 5) + 0x1F;
 		// Note that the 1 meter probes I purchased on AliExpress have turned out to
 		// be clones, not original Dallas/Maxim chips.
 		// See https://github.com/cpetrich/counterfeit_DS18B20
@@ -91,31 +179,15 @@ void DS18B20Multidrop::begin(void)
 		// ROM 28 E8 0A 69 2D 19 01 AC
 		// ROM 28 A3 81 72 2D 19 01 36
 		// ROM 28 1F 66 51 2D 19 01 3F
+		//
+		// Fingerprint() identifies these from their ROM patterns and measures
+		// what each actually does.
 
-	#ifdef DUMP_TO_SERIAL
-		Serial.print(F("In 0x"));
-		Serial.print(scratchPad.data[2], HEX);
-		Serial.print(' ');
-		Serial.print(scratchPad.data[3], HEX);
-		Serial.print(' ');
-		Serial.println(scratchPad.data[4], HEX);
-	#endif
-		/*
-		*	EEPROM values are copied to the scratch pad SRAM when power is
-		*	applied.  The only reason you would rely on the EEPROM values being
-		*	copied is if you wanted to set the alarm and config values once, or
-		*	very infrequently.  The problem is the EEPROM values on newly added
-		*	thermometers would have to be initialized somehow. Rather than deal
-		*	with that this code just loads the SRAM values on startup
-		*	overwriting whatever config values were loaded from EEPROM.
-		*/
-		mOneWire.reset();
-		mOneWire.skip();	// Broadcast to all thermometers
-		mOneWire.write(eWriteScratchPad);
-		mOneWire.write_bytes(&scratchPad.data[2], 3);
-		mOneWire.reset();
+		DetectPowerMode();
+		WriteConfig();
 		
 	#ifdef DUMP_TO_SERIAL
+		DSScratchPad	scratchPad;
 		scratchPad.f.alarmHigh = 9;
 		scratchPad.f.alarmLow = 9;
 		scratchPad.f.config = 9;
@@ -127,24 +199,227 @@ void DS18B20Multidrop::begin(void)
 		Serial.print(' ');
 		Serial.println(scratchPad.f.config, HEX);
 	#endif
-		/*
-		*	initialize any garbage values in the thermometer array.
-		*/
 		for (uint8_t i = 0; i < mCount; i++)
 		{
-			mThermometer[i].temp = 0;
-			mThermometer[i].changed = false;
-			mThermometer[i].alarm = false;
+			Fingerprint(i);
 		}
-		mUpdatePeriod.Start();
-		mDataIsValid = false;
+	}
+	Refresh();
+	mUpdatePeriod.Start();
+}
+
+/********************************** Refresh ***********************************/
+/*
+*	Each known thermometer is verified with an addressed, CRC checked read of
+*	its scratch pad (~11ms per thermometer.)  The scratch pad still holds the
+*	most recent conversion so the readings of the thermometers present are
+*	kept and valid without waiting for the next update.  A thermometer that
+*	doesn't respond after kMaxReadRetries retries is marked invalid rather than
+*	removed so that a transient fault (e.g. a long cable at wake) doesn't
+*	shift the indexes or lose its cached limits.  It's removed after
+*	kMaxRefreshFailures consecutive failed refreshes.  A thermometer whose
+*	TH/TL/config doesn't match (e.g. it was power cycled) is rewritten.
+*
+*	The bus resets and reads would cut a parasite powered conversion short
+*	(strong pullup) and make ConversionDone() see the read slots as the
+*	conversion having completed, so while a conversion is in progress or being
+*	read the refresh is deferred to Update() after the conversion is read.
+*
+*	New thermometers are found by the background search, one search pass per
+*	update, see Update().
+*/
+void DS18B20Multidrop::Refresh(void)
+{
+	if (mConversionPeriod.Get() != 0 ||
+		mAsyncIndex < mCount)
+	{
+		mRefreshPending = true;
+		return;
+	}
+	mRefreshPending = false;
+	if (mSampling)
+	{
+		SetOversampling(mOversamples);	// Discard the unfinished burst
+	}
+	DetectPowerMode();
+	bool	removed = false;
+	uint8_t	i = 0;
+	mRefreshing = true;
+	while (i < mCount)
+	{
+		DSScratchPad	scratchPad;
+		DSScratchPad	config;
+		bool	success = false;
+		for (uint8_t attempt = 0; !success && attempt <= kMaxReadRetries; attempt++)
+		{
+			success = ReadScratchPad(i, scratchPad);
+		}
+		if (success)
+		{
+			mInfo[i].refreshFailures = 0;
+			ConfigScratchPad(i, config);
+			/*
+			*	The config byte is compared to the resolution the thermometer
+			*	actually uses.  Some clones ignore the resolution setting.
+			*/
+			if (memcmp(&scratchPad.data[2], &config.data[2], 2) ||
+				scratchPad.f.config != ((mInfo[i].resolution << 5) | 0x1F))
+			{
+				WriteScratchPad(i, config, false);
+			}
+			ApplyReading(i, scratchPad);
+			if (IsValid(i))
+			{
+				mDataIsValid = true;
+			}
+			i++;
+			continue;
+		}
+		Increment(mInfo[i].refreshFailures);
+		if (mInfo[i].refreshFailures < kMaxRefreshFailures)
+		{
+			ClearBit(mValidBits, i);
+			i++;
+			continue;
+		}
+		RemoveThermometer(i);
+		removed = true;
+	}
+	mRefreshing = false;
+	if (removed)
+	{
+		SaveROMCache();
+	}
+	mDiscoveryBus = 0;
+	mBus[0]->target_search(0x28);
+}
+
+/****************************** ConfigScratchPad ******************************/
+/*
+*	Sets the TH, TL and config bytes of outScratchPad to the values written to
+*	the thermometer at inIndex.  Pass 0xFF to get the values broadcast to all.
+*/
+void DS18B20Multidrop::ConfigScratchPad(
+	uint8_t			inIndex,
+	DSScratchPad&	outScratchPad) const
+{
+	outScratchPad.f.alarmHigh = GetAlarmHigh(inIndex) >> 4;
+	outScratchPad.f.alarmLow = (GetAlarmLow(inIndex) + 15) >> 4;
+	outScratchPad.f.config = (mResolution << 5) + 0x1F;
+}
+
+/******************************** WriteConfig *********************************/
+/*
+*	EEPROM values are copied to the scratch pad SRAM when power is applied.
+*	The only reason you would rely on the EEPROM values being copied is if you
+*	wanted to set the alarm and config values once, or very infrequently.  The
+*	problem is the EEPROM values on newly added thermometers would have to be
+*	initialized somehow. Rather than deal with that this code just loads the
+*	SRAM values on startup overwriting whatever config values were loaded from
+*	EEPROM.
+*
+*	The thermometer compares only the integer part of the temperature with
+*	TH/TL (temp >= TH or temp <= TL.)  TH is rounded down and TL rounded up so
+*	that the thermometer alarms on a superset of the alarm high/low of this
+*	class.  The actual alarm state is determined after reading the temperature.
+*/
+bool DS18B20Multidrop::WriteConfig(void)
+{
+	DSScratchPad	scratchPad;
+	ConfigScratchPad(0xFF, scratchPad);
+#ifdef DUMP_TO_SERIAL
+	Serial.print(F("In 0x"));
+	Serial.print(scratchPad.data[2], HEX);
+	Serial.print(' ');
+	Serial.print(scratchPad.data[3], HEX);
+	Serial.print(' ');
+	Serial.println(scratchPad.data[4], HEX);
+#endif
+	uint8_t	success = 0;
+	for (uint8_t bus = 0; bus < mBusCount; bus++)
+	{
+		OneWire&	oneWire = *mBus[bus];
+		if (oneWire.reset())
+		{
+			oneWire.skip();	// Broadcast to all thermometers on this bus
+			oneWire.write(eWriteScratchPad);
+			oneWire.write_bytes(&scratchPad.data[2], 3);
+			success |= oneWire.reset();
+		}
+	}
+	/*
+	*	Thermometers with their own alarm limits are then written individually.
+	*/
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		if (mInfo[i].alarmHigh != kNoAlarmLimit ||
+			mInfo[i].alarmLow != kNoAlarmLimit)
+		{
+			ConfigScratchPad(i, scratchPad);
+			WriteScratchPad(i, scratchPad, false);
+		}
+	}
+	mAlarmLimitsChanged = false;
+	return(success);
+}
+
+/********************************* ResetInfo **********************************/
+/*
+*	Resets the bus health counters.
+*/
+void DS18B20Multidrop::ResetInfo(void)
+{
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		SDS18B20Info&	info = mInfo[i];
+		info.crcErrors = 0;
+		info.presenceFailures = 0;
+		info.retries = 0;
+		info.powerOnReads = 0;
+	}
+	mCRCFailures = 0;
+	mSkippedReads = 0;
+	mSkippedConversions = 0;
+}
+
+/**************************** SetAdaptiveSampling *****************************/
+void DS18B20Multidrop::SetAdaptiveSampling(
+	uint8_t	inMaxInterval,
+	int16_t	inSlopeThreshold,
+	int16_t	inNearThreshold)
+{
+	mMaxInterval = inMaxInterval ? inMaxInterval : 1;
+	mSlopeThreshold = inSlopeThreshold;
+	mNearThreshold = inNearThreshold;
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		mInfo[i].interval = 1;
+		mInfo[i].countdown = 0;
 	}
 }
 
+/***************************** SetTruncatedReads ******************************/
+void DS18B20Multidrop::SetTruncatedReads(
+	uint8_t	inFullReadCycles,
+	int16_t	inJumpThreshold)
+{
+	mFullReadCycles = inFullReadCycles;
+	mFullReadCountdown = 0;
+	mJumpThreshold = inJumpThreshold;
+}
+
+/***************************** SetAlarmSearchMode *****************************/
+void DS18B20Multidrop::SetAlarmSearchMode(
+	uint8_t	inFullSweepCycles)
+{
+	mFullSweepCycles = inFullSweepCycles;
+	mSweepCountdown = 0;
+}
+
 /*********************************** Update ***********************************/
 /*
-*	This performs a periodic update of the thermometer data stored in
-*	mThermometer.  This is called on a regular basis when the MCU is not
+*	This performs a periodic update of the thermometer data stored in the
+*	thermometer arrays.  This is called on a regular basis when the MCU is not
 *	not sleeping.  The MCU must be awake otherwise the timers used to determine
 *	when a conversion has completed and when a new conversion/update should take
 *	place would be inaccurate.
@@ -153,6 +428,10 @@ bool DS18B20Multidrop::Update(
 	bool	inResetAlarms)
 {
 	bool dataUpdated = DataUpdated(inResetAlarms);
+	if (mRefreshPending)
+	{
+		Refresh();
+	}
 	/*
 	*	The mConversionPeriod must be less than mUpdatePeriod otherwise the
 	*	data update would never finish.
@@ -160,31 +439,277 @@ bool DS18B20Multidrop::Update(
 	if (mUpdatePeriod.Passed())
 	{
 		mUpdatePeriod.Start();
+		/*
+		*	The background search runs at low priority, one search pass per
+		*	update period, and only while the buses are idle.  The alarm
+		*	search shares the OneWire search state so in alarm search mode the
+		*	whole background search is performed at once.
+		*/
+		if (mDiscoveryBus < mBusCount &&
+			mAsyncIndex >= mCount &&
+			mConversionPeriod.Get() == 0)
+		{
+			do
+			{
+				DiscoveryStep();
+			} while (mFullSweepCycles && mDiscoveryBus < mBusCount);
+		}
 		BeginDataUpdate();
 	}
 	return(dataUpdated);
 }
 
+/************************************ Run *************************************/
+/*
+*	Update() split into steps so that a single call doesn't start a
+*	conversion, search and read the buses all at once.  Reading a conversion
+*	is still one step: when there's no OneWireAsync each thermometer due is
+*	read in turn.
+*/
+uint32_t DS18B20Multidrop::Run(void)
+{
+	if (mConversionPeriod.Get() != 0 ||
+		mAsyncIndex < mCount)
+	{
+		if (DataUpdated(false))
+		{
+			mNewReading = true;
+		}
+	} else if (mRefreshPending)
+	{
+		Refresh();
+	} else if (mDiscoveryDue)
+	{
+		mDiscoveryDue = false;
+		do
+		{
+			DiscoveryStep();
+		} while (mFullSweepCycles && mDiscoveryBus < mBusCount);
+	} else if (mUpdatePeriod.Passed())
+	{
+		mUpdatePeriod.Start();
+		mDiscoveryDue = mDiscoveryBus < mBusCount;
+		BeginDataUpdate();
+	}
+	uint32_t	delay = 0;
+	if (mConversionPeriod.Get() == 0 &&
+		mAsyncIndex >= mCount &&
+		!mSampling &&
+		!mRefreshPending &&
+		!mDiscoveryDue)
+	{
+		uint32_t	elapsed = mUpdatePeriod.ElapsedTime();
+		if (elapsed < mUpdatePeriod.Get())
+		{
+			delay = mUpdatePeriod.Get() - elapsed;
+		}
+	}
+	return(delay);
+}
+
 /****************************** BeginDataUpdate *******************************/
 /*
-*	This starts a read conversion of all thermometers on the OneWire bus.
+*	This starts a read conversion of all thermometers on all of the OneWire
+*	buses.  The conversions on each bus run at the same time.
 *	Update() or DataUpdated() should be called till the data has been updated.
 *	The MCU must remain awake until the data update completes.
+*
+*	With adaptive sampling only the thermometers that are due are converted.
+*	In oversampling mode this starts the first conversion of the burst.
 */
 bool DS18B20Multidrop::BeginDataUpdate(void)
 {
-	uint8_t	success = mOneWire.reset();
+	if (mAsyncIndex < mCount)
+	{
+		return(false);	// The previous async sweep hasn't finished
+	}
+	if (mAlarmLimitsChanged)
+	{
+		WriteConfig();
+	}
+	/*
+	*	With adaptive sampling, count down each thermometer's interval.
+	*/
+	uint8_t	dueCount = 0;
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		SDS18B20Info&	info = mInfo[i];
+		if (info.countdown)
+		{
+			info.countdown--;
+		}
+		if (info.countdown == 0)
+		{
+			dueCount++;
+		}
+	}
+	bool	success = false;
+	if (dueCount)
+	{
+		mBurstRemaining = mOversamples - 1;
+		mBurstStartTime = micros();
+		mConversionStartTime = millis();
+		success = StartConversion();
+		mSampling = success && mOversamples > 1;
+	} else
+	{
+		mSkippedConversions++;
+	}
+	return(success);
+}
+
+/****************************** StartConversion *******************************/
+/*
+*	Starts a conversion of the thermometers that are due (countdown 0.)  When
+*	all are due the convert command is broadcast on each bus, otherwise each
+*	due thermometer is addressed.  The conversion period is that of the
+*	slowest thermometer converting.
+*
+*	On a parasite powered bus the convert command is always broadcast and the
+*	bus is held high till ConversionDone() (a reset or a second convert
+*	command would cut the power of the thermometers already converting.)
+*	When externally powered, the bus isn't reset after the convert command so
+*	that ConversionDone() can poll for completion using read time slots.
+*/
+bool DS18B20Multidrop::StartConversion(void)
+{
+	uint8_t	dueCount = 0;
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		if (mInfo[i].countdown == 0)
+		{
+			dueCount++;
+		}
+	}
+	uint8_t	broadcastBuses = dueCount == mCount ? 0xFF : mParasiteBuses;
+	uint16_t	conversionPeriod = 0;
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		if (mInfo[i].countdown == 0 ||
+			(broadcastBuses & _BV(mInfo[i].bus)))
+		{
+			uint16_t	period = ConversionPeriod(i);
+			if (period > conversionPeriod)
+			{
+				conversionPeriod = period;
+			}
+		}
+	}
+	uint8_t	success = 0;
+	mConvertingBuses = 0;
+	for (uint8_t bus = 0; bus < mBusCount; bus++)
+	{
+		OneWire&	oneWire = *mBus[bus];
+		if ((broadcastBuses & _BV(bus)) &&
+			oneWire.reset())
+		{
+			oneWire.skip();	// Broadcast to all thermometers on this bus
+			oneWire.write(eConvertTemperature, IsParasitePowered(bus));
+			mConvertingBuses |= _BV(bus);
+			success = 1;
+		}
+	}
+	/*
+	*	Only the due thermometers on the remaining buses convert.  A
+	*	thermometer only responds to read time slots after its own convert
+	*	command, so in polling mode only the last thermometer converted on each
+	*	bus is polled.  The convert commands are issued in ascending order of
+	*	conversion period so that the last, the one polled, is the slowest and
+	*	the others on the bus have completed when it has.
+	*/
+	uint16_t	issuedPeriod = 0;	// Periods <= this have been issued
+	while (true)
+	{
+		uint16_t	nextPeriod = 0xFFFF;
+		for (uint8_t i = 0; i < mCount; i++)
+		{
+			if (mInfo[i].countdown == 0 &&
+				(broadcastBuses & _BV(mInfo[i].bus)) == 0)
+			{
+				uint16_t	period = ConversionPeriod(i);
+				if (period > issuedPeriod &&
+					period < nextPeriod)
+				{
+					nextPeriod = period;
+				}
+			}
+		}
+		if (nextPeriod == 0xFFFF)
+		{
+			break;
+		}
+		for (uint8_t i = 0; i < mCount; i++)
+		{
+			if (mInfo[i].countdown == 0 &&
+				(broadcastBuses & _BV(mInfo[i].bus)) == 0 &&
+				ConversionPeriod(i) == nextPeriod)
+			{
+				OneWire&	oneWire = Bus(i);
+				if (oneWire.reset())
+				{
+					oneWire.select(mAddress[i]);
+					oneWire.write(eConvertTemperature);
+					mConvertingBuses |= _BV(mInfo[i].bus);
+					success = 1;
+				}
+			}
+		}
+		issuedPeriod = nextPeriod;
+	}
 	if (success)
 	{
-		mOneWire.skip();	// Broadcast to all thermometers
-		mOneWire.write(eConvertTemperature);
-		success = mOneWire.reset();
-		mConversionPeriod.Set((1<<mResolution) * 94);// Roughly 94, 188, 376, 752 ms
+		// The period is the upper bound when polling.
+		mConversionPeriod.Set(conversionPeriod);
 		mConversionPeriod.Start();
 	}
 	return(success);
 }
 
+/******************************* ConversionDone *******************************/
+/*
+*	While any thermometer on a bus is converting it responds to a read time
+*	slot with 0.  When all have completed a 1 is read.  A read slot is ~70us so
+*	polling on every call is cheap.  Each externally powered bus still
+*	converting is polled.  Parasite powered buses are held high till the
+*	conversion period has passed.
+*/
+bool DS18B20Multidrop::ConversionDone(void)
+{
+	bool	done = mConversionPeriod.Passed();
+	if (mConversionPeriod.Get())
+	{
+		if (!done)
+		{
+			for (uint8_t bus = 0; bus < mBusCount; bus++)
+			{
+				if ((mConvertingBuses & ~mParasiteBuses & _BV(bus)) &&
+					mBus[bus]->read_bit())
+				{
+					mConvertingBuses &= ~_BV(bus);
+				}
+			}
+			done = mConvertingBuses == 0;
+		}
+		if (done)
+		{
+			for (uint8_t bus = 0; bus < mBusCount; bus++)
+			{
+				if (mConvertingBuses & mParasiteBuses & _BV(bus))
+				{
+					mBus[bus]->depower();	// Release the strong pullup
+				}
+			}
+			mConvertingBuses = 0;
+			mConversionTime = mConversionPeriod.ElapsedTime();
+			if (mConversionTime > mMaxConversionTime)
+			{
+				mMaxConversionTime = mConversionTime;
+			}
+		}
+	}
+	return(done);
+}
+
 /******************************** DataUpdated *********************************/
 /*
 *	This is repeatedly called after a read/conversion has started via a call to
@@ -204,106 +729,1161 @@ bool DS18B20Multidrop::BeginDataUpdate(void)
 bool DS18B20Multidrop::DataUpdated(
 	bool	inResetAlarms)
 {
-	bool dataUpdated = mConversionPeriod.Passed();
-	if (dataUpdated)
+	bool dataUpdated;
+	if (mAsyncIndex < mCount)
+	{
+		dataUpdated = ContinueAsyncSweep();
+	} else if ((dataUpdated = ConversionDone()) != false)
 	{
 		mDataIsValid = true;
-		if (inResetAlarms)
+		// In oversampling mode the alarms are only reset on the first sample.
+		if (inResetAlarms &&
+			mBurstRemaining == mOversamples - 1)
 		{
 			ResetAlarm();
 		}
 
 		mConversionPeriod.Set(0);
-		DSScratchPad	scratchPad;
-	
-		for (uint8_t i = 0; i < mCount; i++)
+		/*
+		*	In truncated read mode the full scratch pads are only read every
+		*	mFullReadCycles updates.
+		*/
+		mFullRead = mFullReadCountdown == 0;
+		if (mFullRead)
+		{
+			mFullReadCountdown = mFullReadCycles;
+		} else
+		{
+			mFullReadCountdown--;
+		}
+		uint32_t	startTime = micros();
+		/*
+		*	In alarm search mode, only the alarming thermometers are read
+		*	between full sweeps.
+		*/
+		if (mSweepCountdown)
+		{
+			mSweepCountdown--;
+			ReadAlarmingThermometers();
+			mAlarmSearchBusTime = micros() - startTime;
+		} else
 		{
-			if (ReadScratchPad(i, scratchPad))
+			mSweepCountdown = mFullSweepCycles;
+			if (mAsync &&
+				mCount)
+			{
+				mSweepStartTime = startTime;
+				mAsyncIndex = 0;
+				dataUpdated = !StartNextAsyncRead();
+			} else
 			{
-				if (scratchPad.f.temp != mThermometer[i].temp)
+				for (uint8_t i = 0; i < mCount; i++)
 				{
-					mTemperatureChanged = true;
-					mThermometer[i].changed = true;
-					mThermometer[i].temp = scratchPad.f.temp;
-
-					// This could be done with an alarm search command, but since
-					// we're getting the temperture anyway, it's faster to check it
-					// here.
-					if (!mThermometer[i].alarm &&
-						(scratchPad.f.temp >= mAlarmHigh ||
-							scratchPad.f.temp <= mAlarmLow))
+					if (mInfo[i].countdown == 0)
 					{
-						mAlarm = true;
-						mThermometer[i].alarm = true;
+						UpdateThermometer(i);
+					} else
+					{
+						mSkippedReads++;
+						RestoreAlarm(i);	// In case the alarms were reset
 					}
 				}
+				mSweepBusTime = micros() - startTime;
 			}
 		}
 	}
+	if (dataUpdated &&
+		mSampling)
+	{
+		dataUpdated = SampleDone();
+	}
 	return(dataUpdated);
 }
 
-/************************** ResetTemperatureChanged ***************************/
-void DS18B20Multidrop::ResetTemperatureChanged(void)
+/******************************* SetOversampling *******************************/
+void DS18B20Multidrop::SetOversampling(
+	uint8_t	inSamples)
 {
-	mTemperatureChanged = false;
+	mOversamples = inSamples == 0 ? 1 :
+					(inSamples > kMaxOversamples ? kMaxOversamples : inSamples);
+	mBurstRemaining = 0;
+	mSampling = false;
 	for (uint8_t i = 0; i < mCount; i++)
 	{
-		mThermometer[i].changed = false;
+		mFilter[i].count = 0;
 	}
 }
 
-/********************************* ResetAlarm *********************************/
+/********************************* SampleDone *********************************/
 /*
-*	The alarm will immediately retrigger if the alarm condition hasn't changed.
+*	Called when the reads following each conversion of a burst are done.
+*	Starts the next conversion of the burst, or finishes the burst.  Returns
+*	true when the burst has finished.
 */
-void DS18B20Multidrop::ResetAlarm(void)
+bool DS18B20Multidrop::SampleDone(void)
 {
-	mAlarm = false;
-	for (uint8_t i = 0; i < mCount; i++)
+	if (mBurstRemaining)
 	{
-		mThermometer[i].alarm = false;
+		mBurstRemaining--;
+		if (StartConversion())
+		{
+			return(false);
+		}
 	}
+	FinishBurst();
+	return(true);
 }
 
-/********************************* NewAlarms **********************************/
+/****************************** AccumulateSample ******************************/
+void DS18B20Multidrop::AccumulateSample(
+	uint8_t	inIndex,
+	int16_t	inTemp)
+{
+	SDS18B20Filter&	filter = mFilter[inIndex];
+	if (filter.count == 0)
+	{
+		filter.first = inTemp;
+		filter.sum = 0;
+		filter.sumSq = 0;
+	}
+	int16_t	delta = inTemp - filter.first;
+	filter.sum += delta;
+	/*
+	*	Limiting the deviation to +/-63 (~4C) keeps the sum of kMaxOversamples
+	*	squares within 16 bits.
+	*/
+	if (delta > 63)
+	{
+		delta = 63;
+	} else if (delta < -63)
+	{
+		delta = -63;
+	}
+	filter.sumSq += delta * delta;
+	filter.count++;
+}
+
+/******************************** FinishBurst *********************************/
 /*
-*	Returns the mask of current alarms minus inIgnoreMask (pass 0 to get all.)
-*	Each set bit of the returned mask represents a thermometer with its
-*	alarm flag set.
-*	bit 0 = thermometer index 0, bit 1 = index 1, etc..
+*	The mean of each thermometer's samples becomes its reading.  Thermometers
+*	that weren't read during the burst are unchanged.
+*
+*	mean = first + sum/n						(1/16 C)
+*	variance = (n*sumSq - sum^2)/n^2			((1/16 C)^2 = 1/256 C^2)
 */
-uint8_t DS18B20Multidrop::NewAlarms(
-	uint8_t	inIgnoreMask)
+void DS18B20Multidrop::FinishBurst(void)
 {
-	uint8_t	newAlarms = 0;
-	if (mAlarm)
+	for (uint8_t i = 0; i < mCount; i++)
 	{
-		uint8_t	numThermometers = mCount;
-		for (uint8_t i = 0; i < numThermometers; i++)
+		SDS18B20Filter&	filter = mFilter[i];
+		int16_t	n = filter.count;
+		if (n)
 		{
-			if (mThermometer[i].alarm &&
-				(inIgnoreMask & _BV(i)) == 0)
-			{
-				newAlarms |= _BV(i);
-			}
+			int32_t	sum = filter.sum;
+			int32_t	sum16 = sum * 16;
+			filter.value = (filter.first * 16) +
+							(int16_t)((sum16 + (sum16 < 0 ? -n/2 : n/2)) / n);
+			int32_t	variance = ((int32_t)n * filter.sumSq) - (sum * sum);
+			filter.variance = variance > 0 ? variance / (n * n) : 0;
+			filter.count = 0;
+			SetReading(i, (filter.value + 8) >> 4);
 		}
 	}
-	return(newAlarms);
+	mSampling = false;
+	mBurstTime = micros() - mBurstStartTime;
 }
 
-/******************************* ReadScratchPad *******************************/
-bool DS18B20Multidrop::ReadScratchPad(
-	uint8_t			inIndex,
-	DSScratchPad&	outScratchPad)
+
+/******************************* StartAsyncRead *******************************/
+bool DS18B20Multidrop::StartAsyncRead(
+	uint8_t	inLength)
+{
+	mAsyncLength = inLength;
+	uint8_t	command[10];
+	command[0] = 0x55;	// Match ROM (select)
+	memcpy(&command[1], mAddress[mAsyncIndex], sizeof(OneWireDevAddr));
+	command[9] = eReadScratchPad;
+	return(mAsync->StartTransaction(command, sizeof(command),
+						mAsyncScratchPad.data, inLength));
+}
+
+/***************************** StartNextAsyncRead *****************************/
+/*
+*	Starts the async read of the thermometer at mAsyncIndex.  Thermometers not
+*	on bus 0 (the async engine's pin) are read synchronously.  Returns false
+*	when the sweep has completed.
+*/
+bool DS18B20Multidrop::StartNextAsyncRead(void)
+{
+	for (; mAsyncIndex < mCount; mAsyncIndex++)
+	{
+		if (mInfo[mAsyncIndex].countdown)
+		{
+			mSkippedReads++;
+			RestoreAlarm(mAsyncIndex);	// In case the alarms were reset
+			continue;
+		}
+		if (mInfo[mAsyncIndex].bus == 0)
+		{
+			mAsyncAttempt = 0;
+			StartAsyncRead(mFullRead ? sizeof(DSScratchPad) : sizeof(int16_t));
+			return(true);
+		}
+		UpdateThermometer(mAsyncIndex);
+	}
+	mSweepBusTime = micros() - mSweepStartTime;
+	return(false);
+}
+
+/***************************** ContinueAsyncSweep *****************************/
+/*
+*	Called from DataUpdated while an async sweep is in progress.  When the
+*	current read completes it's validated and applied (or retried), and the
+*	read of the next thermometer is started.  Returns true when all of the
+*	thermometers have been read.  The validation is the same as
+*	UpdateThermometer.
+*/
+bool DS18B20Multidrop::ContinueAsyncSweep(void)
+{
+	if (mAsync->IsBusy())
+	{
+		return(false);
+	}
+	SDS18B20Info&	info = mInfo[mAsyncIndex];
+	bool	success = mAsync->Status() == OneWireAsync::eDone;
+	if (!success)
+	{
+		Increment(info.presenceFailures);
+	} else if (mAsyncLength == sizeof(DSScratchPad))
+	{
+		if (OneWire::crc8(mAsyncScratchPad.data, 8) != mAsyncScratchPad.f.crc)
+		{
+			mCRCFailures++;
+			Increment(info.crcErrors);
+			success = false;
+		}
+	} else
+	{
+		int16_t	delta = mAsyncScratchPad.f.temp - mTemp[mAsyncIndex];
+		if (!BitIsSet(mValidBits, mAsyncIndex) ||
+			delta > mJumpThreshold ||
+			delta < -mJumpThreshold)
+		{
+			StartAsyncRead(sizeof(DSScratchPad));	// Verify
+			return(false);
+		}
+		mTruncatedReads++;
+	}
+	if (!success &&
+		mAsyncAttempt < kMaxReadRetries)
+	{
+		mAsyncAttempt++;
+		Increment(info.retries);
+		StartAsyncRead(mAsyncLength);
+		return(false);
+	}
+	if (success)
+	{
+		ApplyReading(mAsyncIndex, mAsyncScratchPad);
+	}
+	mAsyncIndex++;
+	return(!StartNextAsyncRead());
+}
+
+/***************************** UpdateThermometer ******************************/
+/*
+*	Reads the temperature of the thermometer at inIndex and updates its state.
+*
+*	A truncated read that jumps by more than mJumpThreshold from the previous
+*	valid reading is verified by reading the full scratch pad.  A full read
+*	with a bad CRC, or a failed reset, is immediately retried up to
+*	kMaxReadRetries times.  If all attempts fail the previous reading is kept.
+*/
+void DS18B20Multidrop::UpdateThermometer(
+	uint8_t	inIndex)
+{
+	DSScratchPad	scratchPad;
+	SDS18B20Info&	info = mInfo[inIndex];
+	bool	success = false;
+	for (uint8_t attempt = 0; !success && attempt <= kMaxReadRetries; attempt++)
+	{
+		if (attempt)
+		{
+			Increment(info.retries);
+		}
+		if (mFullRead)
+		{
+			success = ReadScratchPad(inIndex, scratchPad);
+		} else
+		{
+			success = ReadScratchPad(inIndex, scratchPad, sizeof(int16_t));
+			if (success)
+			{
+				int16_t	delta = scratchPad.f.temp - mTemp[inIndex];
+				if (!BitIsSet(mValidBits, inIndex) ||
+					delta > mJumpThreshold ||
+					delta < -mJumpThreshold)
+				{
+					success = ReadScratchPad(inIndex, scratchPad);
+				} else
+				{
+					mTruncatedReads++;
+				}
+			}
+		}
+	}
+	if (success)
+	{
+		ApplyReading(inIndex, scratchPad);
+	}
+}
+
+/******************************** ApplyReading ********************************/
+/*
+*	Updates the state of the thermometer at inIndex from a validated read.
+*
+*	The power-on value of 85C is rejected unless the previous reading was near
+*	85C.  This happens when a thermometer resets (e.g. a brownout on a long
+*	cable) and misses the convert command.
+*/
+void DS18B20Multidrop::ApplyReading(
+	uint8_t				inIndex,
+	const DSScratchPad&	inScratchPad)
+{
+	int16_t	temp = inScratchPad.f.temp;
+	if (temp == kPowerOnTemp)
+	{
+		int16_t	delta = kPowerOnTemp - mTemp[inIndex];
+		if (!BitIsSet(mValidBits, inIndex) ||
+			delta > kPowerOnTempWindow ||
+			delta < -kPowerOnTempWindow)
+		{
+			Increment(mInfo[inIndex].powerOnReads);
+			return;
+		}
+	}
+	if (mSampling)
+	{
+		AccumulateSample(inIndex, temp);
+	} else
+	{
+		SetReading(inIndex, temp);
+	}
+}
+
+/********************************* SetReading *********************************/
+/*
+*	A reread of the last conversion (Refresh) only restores the reading.  It
+*	isn't a new sample so the interval, alarm confirmation and trend are left
+*	as they were.
+*/
+void DS18B20Multidrop::SetReading(
+	uint8_t	inIndex,
+	int16_t	inTemp)
+{
+	mInfo[inIndex].refreshFailures = 0;
+	UpdateTrend(inIndex, inTemp);
+	if (BitIsSet(mValidBits, inIndex) &&
+		!mRefreshing)
+	{
+		AdaptInterval(inIndex, inTemp - mTemp[inIndex]);
+	}
+	SetBit(mValidBits, inIndex);
+	if (inTemp != mTemp[inIndex])
+	{
+		mTemperatureChanged = true;
+		SetBit(mChangedBits, inIndex);
+		mTemp[inIndex] = inTemp;
+	}
+	if (mRefreshing)
+	{
+		return;
+	}
+	/*
+	*	The alarm is checked even when the temperature hasn't changed
+	*	because the alarm may have been reset.
+	*/
+	CheckAlarm(inIndex);
+	CheckTrend(inIndex);
+}
+
+/********************************* CheckAlarm *********************************/
+/*
+*	Called for each new reading.  An alarm is raised after mAlarmConfirm
+*	consecutive readings at or beyond a limit, each from a distinct
+*	conversion.  A reread of the last conversion (Refresh) doesn't count
+*	toward the confirmation.  Unless latched, it's cleared by a reading more
+*	than mAlarmHysteresis inside both limits.  A reading within the hysteresis
+*	band leaves the alarm as is.
+*
+*	For the alarm latency trace the conversion start of the first reading
+*	beyond the limit is kept, and the confirming reading records the raise.
+*	No trace is started or confirmed while refreshing because
+*	mConversionStartTime may be from before the MCU slept.
+*/
+void DS18B20Multidrop::CheckAlarm(
+	uint8_t	inIndex)
+{
+	SDS18B20Info&	info = mInfo[inIndex];
+	int16_t	temp = mTemp[inIndex];
+	int16_t	alarmHigh = GetAlarmHigh(inIndex);
+	int16_t	alarmLow = GetAlarmLow(inIndex);
+	if (temp >= alarmHigh ||
+		temp <= alarmLow)
+	{
+		if (!mRefreshing)
+		{
+			Increment(info.alarmCount);
+			if (info.alarmCount == 1)
+			{
+				info.crossTime = mConversionStartTime >> 8;
+			}
+			if (info.alarmCount == mAlarmConfirm &&
+				!mAlarmTraced)
+			{
+				uint32_t	now = millis();
+				uint16_t	elapsed = (uint16_t)(now >> 8) - info.crossTime;
+				mAlarmTraceStart = now - ((uint32_t)elapsed << 8);
+				mAlarmTraceRead = now;
+				mAlarmTraced = true;
+			}
+		}
+	} else
+	{
+		info.alarmCount = 0;
+		if (!mAlarmLatch &&
+			BitIsSet(mAlarmBits, inIndex) &&
+			temp < (alarmHigh - mAlarmHysteresis) &&
+			temp > (alarmLow + mAlarmHysteresis))
+		{
+			ClearBit(mAlarmBits, inIndex);
+			UpdateAlarm();
+		}
+	}
+	RestoreAlarm(inIndex);
+}
+
+/******************************** RestoreAlarm ********************************/
+/*
+*	Sets the alarm of the thermometer at inIndex if its alarm is confirmed.
+*	Called for thermometers not read in an update in case the alarms were
+*	reset.
+*/
+void DS18B20Multidrop::RestoreAlarm(
+	uint8_t	inIndex)
+{
+	if (mInfo[inIndex].alarmCount >= mAlarmConfirm)
+	{
+		mAlarm = true;
+		SetBit(mAlarmBits, inIndex);
+	}
+}
+
+/******************************** UpdateAlarm *********************************/
+/*
+*	The overall alarm state is the OR of the packed alarm bits, one byte per 8
+*	thermometers.
+*/
+void DS18B20Multidrop::UpdateAlarm(void)
+{
+	uint8_t	alarmBits = 0;
+	uint8_t	bitsetSize = BitsetSize(mCount);
+	for (uint8_t i = 0; i < bitsetSize; i++)
+	{
+		alarmBits |= mAlarmBits[i];
+	}
+	mAlarm = alarmBits != 0;
+}
+
+/******************************* SetAlarmFilter *******************************/
+void DS18B20Multidrop::SetAlarmFilter(
+	int16_t	inHysteresis,
+	uint8_t	inConfirmReadings,
+	bool	inLatch)
+{
+	mAlarmHysteresis = inHysteresis;
+	mAlarmConfirm = inConfirmReadings ? inConfirmReadings : 1;
+	mAlarmLatch = inLatch;
+}
+
+/******************************** SetAlarmHigh ********************************/
+void DS18B20Multidrop::SetAlarmHigh(
+	uint8_t	inIndex,
+	int16_t	inAlarmHigh)
+{
+	if (inIndex < mCount)
+	{
+		mInfo[inIndex].alarmHigh = inAlarmHigh;
+		mAlarmLimitsChanged = true;
+		SaveROMCache();
+	}
+}
+
+/******************************** SetAlarmLow *********************************/
+void DS18B20Multidrop::SetAlarmLow(
+	uint8_t	inIndex,
+	int16_t	inAlarmLow)
+{
+	if (inIndex < mCount)
+	{
+		mInfo[inIndex].alarmLow = inAlarmLow;
+		mAlarmLimitsChanged = true;
+		SaveROMCache();
+	}
+}
+
+/****************************** ClearAlarmLimits ******************************/
+/*
+*	Removes the per thermometer alarm high and/or low limits so that the alarm
+*	high/low applies to all.
+*/
+void DS18B20Multidrop::ClearAlarmLimits(
+	bool	inHigh,
+	bool	inLow)
+{
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		if (inHigh)
+		{
+			mInfo[i].alarmHigh = kNoAlarmLimit;
+		}
+		if (inLow)
+		{
+			mInfo[i].alarmLow = kNoAlarmLimit;
+		}
+	}
+	mAlarmLimitsChanged = true;
+	SaveROMCache();
+}
+
+/****************************** SetUpdatePeriod *******************************/
+/*
+*	The trend slopes are per update period so they're rescaled to the new
+*	period rather than relearned.
+*/
+void DS18B20Multidrop::SetUpdatePeriod(
+	uint32_t	inPeriod)
+{
+	uint32_t	oldPeriod = mUpdatePeriod.Get();
+	if (oldPeriod &&
+		inPeriod &&
+		inPeriod != oldPeriod)
+	{
+		for (uint8_t i = 0; i < mCount; i++)
+		{
+			mInfo[i].trendSlope = ((int64_t)mInfo[i].trendSlope * inPeriod) / oldPeriod;
+		}
+	}
+	mUpdatePeriod.Set(inPeriod);
+	mUpdatePeriod.Start();
+	ScaleTrendLimits();
+}
+
+/******************************* SetTrendAlarm ********************************/
+void DS18B20Multidrop::SetTrendAlarm(
+	uint16_t	inHorizon,
+	int16_t		inMinSlope)
+{
+	mTrendHorizon = inHorizon;
+	mTrendMinSlope = inMinSlope;
+	ScaleTrendLimits();
+	if (inHorizon == 0)
+	{
+		memset(mTrendBits, 0, BitsetSize(mCapacity));
+	}
+}
+
+/****************************** ScaleTrendLimits ******************************/
+/*
+*	The trend is smoothed per update period so the horizon and minimum slope
+*	are converted to update periods.
+*/
+void DS18B20Multidrop::ScaleTrendLimits(void)
+{
+	uint32_t	period = mUpdatePeriod.Get();
+	uint32_t	periods = period ? ((uint32_t)mTrendHorizon * 60000) / period : 0;
+	mTrendPeriods = periods < 0xFFFF ? periods : 0xFFFF;
+	uint32_t	periodsPerHour = period ? 3600000 / period : 0;
+	if (periodsPerHour == 0)
+	{
+		periodsPerHour = 1;
+	}
+	mTrendMinRate = ((int32_t)mTrendMinSlope << 12) / (int32_t)periodsPerHour;
+	if (mTrendMinRate < 1)
+	{
+		mTrendMinRate = 1;
+	}
+}
+
+/******************************** UpdateTrend *********************************/
+/*
+*	Double exponential smoothing of the thermometer's readings.  The level is
+*	moved 1/8 of the way from the prediction (level + slope * elapsed periods)
+*	to the reading, and the slope 1/64 of the way to the slope implied by the
+*	new level.  At 9 bit resolution a slow change is a 0.5C step every few
+*	minutes, hence the long slope time constant.
+*
+*	The level is 1/65536 C (the reading << 12) so that slopes of a fraction of
+*	a degree per hour don't vanish.  A reread of the last conversion (Refresh)
+*	isn't a new reading so it only initializes the level.
+*/
+void DS18B20Multidrop::UpdateTrend(
+	uint8_t	inIndex,
+	int16_t	inTemp)
+{
+	SDS18B20Info&	info = mInfo[inIndex];
+	int32_t	reading = (int32_t)inTemp << 12;
+	if (info.trendLevel == kNoTrend)
+	{
+		info.trendLevel = reading;
+		info.trendSlope = 0;
+	} else if (!mRefreshing)
+	{
+		int32_t	elapsed = info.interval ? info.interval : 1;
+		int32_t	predicted = info.trendLevel + info.trendSlope * elapsed;
+		int32_t	level = predicted + ((reading - predicted) >> kTrendLevelShift);
+		info.trendSlope += (((level - info.trendLevel) / elapsed) -
+								info.trendSlope) >> kTrendSlopeShift;
+		info.trendLevel = level;
+	}
+}
+
+/********************************* CheckTrend *********************************/
+void DS18B20Multidrop::CheckTrend(
+	uint8_t	inIndex)
+{
+	if (mTrendHorizon &&
+		PeriodsToAlarm(inIndex) < mTrendPeriods)
+	{
+		SetBit(mTrendBits, inIndex);
+	} else
+	{
+		ClearBit(mTrendBits, inIndex);
+	}
+}
+
+/******************************* PeriodsToAlarm *******************************/
+/*
+*	Returns the number of update periods till the smoothed temperature reaches
+*	the alarm high or low at the smoothed slope.  Returns 0xFFFF if the slope
+*	is less than the minimum or the limit has already been reached (that's the
+*	threshold alarm's job.)  Dividing rather than projecting the level forward
+*	avoids overflow.
+*/
+uint16_t DS18B20Multidrop::PeriodsToAlarm(
+	uint8_t	inIndex) const
+{
+	const SDS18B20Info&	info = mInfo[inIndex];
+	int32_t	slope = info.trendSlope;
+	int32_t	distance = 0;
+	if (info.trendLevel != kNoTrend)
+	{
+		if (slope >= mTrendMinRate)
+		{
+			distance = ((int32_t)GetAlarmHigh(inIndex) << 12) - info.trendLevel;
+		} else if (slope <= -mTrendMinRate)
+		{
+			distance = info.trendLevel - ((int32_t)GetAlarmLow(inIndex) << 12);
+			slope = -slope;
+		}
+	}
+	uint16_t	periods = 0xFFFF;
+	if (distance > 0)
+	{
+		int32_t	quotient = distance / slope;
+		if (quotient < 0xFFFF)
+		{
+			periods = quotient;
+		}
+	}
+	return(periods);
+}
+
+/******************************* GetTimeToAlarm *******************************/
+uint16_t DS18B20Multidrop::GetTimeToAlarm(
+	uint8_t	inIndex) const
+{
+	uint16_t	minutes = kNoTimeToAlarm;
+	uint16_t	periods = PeriodsToAlarm(inIndex);
+	if (periods != 0xFFFF)
+	{
+		uint32_t	time = ((uint32_t)periods * mUpdatePeriod.Get()) / 60000;
+		minutes = time < kNoTimeToAlarm ? time : kNoTimeToAlarm - 1;
+	}
+	return(minutes);
+}
+
+/********************************** GetSlope **********************************/
+int16_t DS18B20Multidrop::GetSlope(
+	uint8_t	inIndex) const
+{
+	int32_t	slope = 0;
+	uint32_t	period = mUpdatePeriod.Get();
+	if (period &&
+		mInfo[inIndex].trendLevel != kNoTrend)
+	{
+		slope = (mInfo[inIndex].trendSlope * (int32_t)(3600000 / period)) >> 12;
+		if (slope > 32767)
+		{
+			slope = 32767;
+		} else if (slope < -32767)
+		{
+			slope = -32767;
+		}
+	}
+	return(slope);
+}
+
+/********************************* TrendAlarm *********************************/
+bool DS18B20Multidrop::TrendAlarm(void) const
+{
+	uint8_t	trendBits = 0;
+	uint8_t	bitsetSize = BitsetSize(mCount);
+	for (uint8_t i = 0; i < bitsetSize; i++)
+	{
+		trendBits |= mTrendBits[i];
+	}
+	return(trendBits != 0);
+}
+
+/********************************* ResetTrend *********************************/
+void DS18B20Multidrop::ResetTrend(void)
+{
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		mInfo[i].trendLevel = kNoTrend;
+		mInfo[i].trendSlope = 0;
+	}
+	memset(mTrendBits, 0, BitsetSize(mCapacity));
+}
+
+/******************************* AdaptInterval ********************************/
+/*
+*	inChange is the change since the previous reading, which was interval
+*	update periods ago.  Sets the countdown to the next read.
+*/
+void DS18B20Multidrop::AdaptInterval(
+	uint8_t	inIndex,
+	int16_t	inChange)
+{
+	SDS18B20Info&	info = mInfo[inIndex];
+	if (mMaxInterval > 1)
+	{
+		int16_t	slope = inChange / (int16_t)info.interval;
+		int16_t	temp = mTemp[inIndex] + inChange;
+		if (slope > mSlopeThreshold ||
+			slope < -mSlopeThreshold ||
+			temp >= (GetAlarmHigh(inIndex) - mNearThreshold) ||
+			temp <= (GetAlarmLow(inIndex) + mNearThreshold))
+		{
+			info.interval = 1;
+		} else if (info.interval < mMaxInterval)
+		{
+			info.interval = info.interval*2 > mMaxInterval ?
+								mMaxInterval : info.interval*2;
+		}
+	}
+	info.countdown = info.interval;
+}
+
+/************************** ReadAlarmingThermometers **************************/
+/*
+*	Uses the conditional alarm search to find the thermometers whose last
+*	conversion is outside of their TH/TL, and reads only those.  The bus time
+*	is proportional to the number of alarming thermometers.
+*/
+void DS18B20Multidrop::ReadAlarmingThermometers(void)
+{
+	OneWireDevAddr	address;
+	uint8_t	hits = 0;
+	for (uint8_t bus = 0; bus < mBusCount; bus++)
+	{
+		OneWire&	oneWire = *mBus[bus];
+		oneWire.reset_search();
+		while (oneWire.search(address, false))
+		{
+			uint8_t	index = FindThermometer(address);
+			if (index < mCount)
+			{
+				hits++;
+				UpdateThermometer(index);
+			}
+		}
+	}
+	mAlarmSearchHits = hits;
+}
+
+/******************************** Fingerprint *********************************/
+/*
+*	Identifies the family of the thermometer at inIndex from its ROM pattern,
+*	see https://github.com/cpetrich/counterfeit_DS18B20
+*	The config is read back to get the resolution the thermometer actually
+*	uses, and, when its bus is externally powered and inMeasure is true, the
+*	conversion time is measured by converting and polling only this
+*	thermometer.  Otherwise the nominal conversion time of the resolution read
+*	back is used.  Measuring busy-waits up to kMaxConversionTime so it's only
+*	done by begin().  A thermometer found by the background search passes
+*	false so that GiveTime() isn't blocked (serial data would be lost.)
+*/
+void DS18B20Multidrop::Fingerprint(
+	uint8_t	inIndex,
+	bool	inMeasure)
+{
+	SDS18B20Info&	info = mInfo[inIndex];
+	const uint8_t*	address = mAddress[inIndex];
+	if (address[5] == 0 &&
+		address[6] == 0)
+	{
+		info.family = eGenuineFamily;
+	} else if (address[1] == 0xFF)
+	{
+		info.family = eCloneFamilyC;
+	} else if (address[6] == 0x01)
+	{
+		info.family = eCloneFamilyB;
+	} else
+	{
+		info.family = eUnknownFamily;
+	}
+	DSScratchPad	scratchPad;
+	info.resolution = mResolution;
+	uint16_t	conversionTime = (1<<mResolution) * 94;// Roughly 94, 188, 376, 752 ms
+	if (ReadScratchPad(inIndex, scratchPad))
+	{
+		info.resolution = (scratchPad.f.config >> 5) & 3;
+		conversionTime = (1<<info.resolution) * 94;
+		if (inMeasure &&
+			!IsParasitePowered(info.bus))
+		{
+			OneWire&	oneWire = Bus(inIndex);
+			if (oneWire.reset())
+			{
+				oneWire.select(address);
+				oneWire.write(eConvertTemperature);
+				uint32_t	startTime = millis();
+				do
+				{
+					conversionTime = millis() - startTime;
+				} while (!oneWire.read_bit() &&
+							conversionTime < kMaxConversionTime);
+			}
+		}
+	}
+	info.conversionTime = (conversionTime + 3) / 4;
+}
+
+/***************************** ConversionPeriod *******************************/
+/*
+*	Returns the time in ms to allow for the thermometer at inIndex to convert.
+*	The fingerprinted conversion time plus a 1/8 margin for temperature and
+*	supply voltage variations.  In parasite power mode this is the time waited
+*	before reading.
+*/
+uint16_t DS18B20Multidrop::ConversionPeriod(
+	uint8_t	inIndex) const
+{
+	uint16_t	period = mInfo[inIndex].conversionTime * 4;
+	if (period == 0)
+	{
+		period = (1<<mResolution) * 94;
+	}
+	return(period + period/8 + 4);
+}
+
+/****************************** DetectPowerMode *******************************/
+/*
+*	A broadcast Read Power Supply command is answered with a 0 read time slot
+*	by any parasite powered thermometer on the bus.
+*/
+void DS18B20Multidrop::DetectPowerMode(void)
+{
+	mParasiteBuses = 0;
+	for (uint8_t bus = 0; bus < mBusCount; bus++)
+	{
+		OneWire&	oneWire = *mBus[bus];
+		bool	parasite = mParasitePower;
+		if (!parasite &&
+			oneWire.reset())
+		{
+			oneWire.skip();
+			oneWire.write(eReadPowerSupply);
+			parasite = !oneWire.read_bit();
+			oneWire.reset();
+		}
+		if (parasite)
+		{
+			mParasiteBuses |= _BV(bus);
+		}
+	}
+}
+
+/******************************* DiscoveryStep ********************************/
+/*
+*	Performs one pass of the targeted search on mDiscoveryBus (~13ms of bus
+*	time.)  A DS18B20 not in the list is added.  When the bus has no more
+*	DS18B20s the search moves to the next bus.
+*/
+void DS18B20Multidrop::DiscoveryStep(void)
 {
-	uint8_t	success = mOneWire.reset();
+	OneWireDevAddr	address;
+	if (mBus[mDiscoveryBus]->search(address) &&
+		address[0] == 0x28)
+	{
+		if (OneWire::crc8(address, 7) == address[7] &&
+			FindThermometer(address) == mCount &&
+			mCount < mCapacity)
+		{
+			AddThermometer(mDiscoveryBus, address);
+		}
+	} else if (++mDiscoveryBus < mBusCount)
+	{
+		mBus[mDiscoveryBus]->target_search(0x28);
+	} else
+	{
+		mDiscoveryBus = 0xFF;
+	}
+}
+
+/******************************* AddThermometer *******************************/
+/*
+*	Appends a thermometer found by the background search and configures it.
+*	It's read by the next update.
+*/
+void DS18B20Multidrop::AddThermometer(
+	uint8_t			inBus,
+	const uint8_t*	inAddress)
+{
+	uint8_t	index = mCount;
+	memcpy(mAddress[index], inAddress, sizeof(OneWireDevAddr));
+	memset(&mInfo[index], 0, sizeof(SDS18B20Info));
+	memset(&mFilter[index], 0, sizeof(SDS18B20Filter));
+	mInfo[index].bus = inBus;
+	mInfo[index].interval = 1;
+	mInfo[index].alarmHigh = kNoAlarmLimit;
+	mInfo[index].alarmLow = kNoAlarmLimit;
+	mInfo[index].trendLevel = kNoTrend;
+	mTemp[index] = 0;
+	ClearBit(mChangedBits, index);
+	ClearBit(mAlarmBits, index);
+	ClearBit(mValidBits, index);
+	ClearBit(mTrendBits, index);
+	mCount++;
+	DSScratchPad	config;
+	ConfigScratchPad(index, config);
+	WriteScratchPad(index, config, false);
+	DetectPowerMode();	// It may be the first parasite powered on its bus
+	Fingerprint(index, false);	// Nominal conversion time, doesn't block
+	SaveROMCache();
+}
+
+/***************************** RemoveThermometer ******************************/
+/*
+*	Removes the thermometer at inIndex.  The thermometers following it move
+*	down one index.
+*/
+void DS18B20Multidrop::RemoveThermometer(
+	uint8_t	inIndex)
+{
+	mCount--;
+	for (uint8_t i = inIndex; i < mCount; i++)
+	{
+		memcpy(mAddress[i], mAddress[i+1], sizeof(OneWireDevAddr));
+		mTemp[i] = mTemp[i+1];
+		mInfo[i] = mInfo[i+1];
+		mFilter[i] = mFilter[i+1];
+		uint8_t*	bitsets[] = {mChangedBits, mAlarmBits, mValidBits, mTrendBits};
+		for (uint8_t j = 0; j < 4; j++)
+		{
+			if (BitIsSet(bitsets[j], i+1))
+			{
+				SetBit(bitsets[j], i);
+			} else
+			{
+				ClearBit(bitsets[j], i);
+			}
+		}
+	}
+	ClearBit(mChangedBits, mCount);
+	ClearBit(mAlarmBits, mCount);
+	ClearBit(mValidBits, mCount);
+	ClearBit(mTrendBits, mCount);
+}
+
+/******************************** LoadROMCache ********************************/
+/*
+*	Loads the thermometer addresses and buses from the ROM cache.  Returns the
+*	number loaded, 0 if there is no cache or it isn't valid (e.g. uninitialized
+*	EEPROM, or the buses have changed.)
+*
+*	ROM cache format:
+*	[0]	uint8_t		count
+*	[1]	count entries of uint8_t bus, OneWireDevAddr address,
+*		int16_t alarm high, int16_t alarm low (kNoAlarmLimit = none)
+*/
+uint8_t DS18B20Multidrop::LoadROMCache(void)
+{
+	uint8_t	count = 0;
+	if (mROMCacheAddr)
+	{
+		uint16_t	addr = mROMCacheAddr;
+		count = EEPROM.read(addr++);
+		if (count > mCapacity)
+		{
+			return(0);
+		}
+		for (uint8_t i = 0; i < count; i++)
+		{
+			mInfo[i].bus = EEPROM.read(addr++);
+			mInfo[i].interval = 1;
+			for (uint8_t k = 0; k < sizeof(OneWireDevAddr); k++)
+			{
+				mAddress[i][k] = EEPROM.read(addr++);
+			}
+			EEPROM.get(addr, mInfo[i].alarmHigh);
+			EEPROM.get(addr+2, mInfo[i].alarmLow);
+			addr += 4;
+			if (mInfo[i].bus >= mBusCount ||
+				OneWire::crc8(mAddress[i], 7) != mAddress[i][7])
+			{
+				return(0);
+			}
+		}
+	}
+	return(count);
+}
+
+/******************************** SaveROMCache ********************************/
+/*
+*	Only the bytes that changed are written (EEPROM.update.)
+*/
+void DS18B20Multidrop::SaveROMCache(void)
+{
+	if (mROMCacheAddr)
+	{
+		uint16_t	addr = mROMCacheAddr;
+		EEPROM.update(addr++, mCount);
+		for (uint8_t i = 0; i < mCount; i++)
+		{
+			EEPROM.update(addr++, mInfo[i].bus);
+			for (uint8_t k = 0; k < sizeof(OneWireDevAddr); k++)
+			{
+				EEPROM.update(addr++, mAddress[i][k]);
+			}
+			EEPROM.put(addr, mInfo[i].alarmHigh);
+			EEPROM.put(addr+2, mInfo[i].alarmLow);
+			addr += 4;
+		}
+	}
+}
+
+/****************************** FindThermometer *******************************/
+/*
+*	Returns the index of the thermometer with inAddress, or mCount if not found.
+*/
+uint8_t DS18B20Multidrop::FindThermometer(
+	const uint8_t*	inAddress) const
+{
+	uint8_t	i = 0;
+	for (; i < mCount; i++)
+	{
+		if (memcmp(mAddress[i], inAddress, sizeof(OneWireDevAddr)) == 0)
+		{
+			break;
+		}
+	}
+	return(i);
+}
+
+/************************** ResetTemperatureChanged ***************************/
+void DS18B20Multidrop::ResetTemperatureChanged(void)
+{
+	mTemperatureChanged = false;
+	memset(mChangedBits, 0, BitsetSize(mCount));
+}
+
+/********************************* ResetAlarm *********************************/
+/*
+*	The alarm will immediately retrigger if the alarm condition hasn't changed.
+*/
+void DS18B20Multidrop::ResetAlarm(void)
+{
+	mAlarm = false;
+	memset(mAlarmBits, 0, BitsetSize(mCount));
+}
+
+/******************************* TakeAlarmTrace *******************************/
+bool DS18B20Multidrop::TakeAlarmTrace(
+	uint32_t&	outConversionStart,
+	uint32_t&	outRead)
+{
+	bool	traced = mAlarmTraced;
+	if (traced)
+	{
+		outConversionStart = mAlarmTraceStart;
+		outRead = mAlarmTraceRead;
+		mAlarmTraced = false;
+	}
+	return(traced);
+}
+
+/********************************* NewAlarms **********************************/
+/*
+*	Sets outNewAlarmBits to the bitset of current alarms minus inIgnoreBits
+*	(pass nullptr to get all.)  Both bitsets are BitsetSize(GetCapacity())
+*	bytes.  Each set bit represents a thermometer with its alarm flag set.
+*	bit 0 of byte 0 = thermometer index 0, bit 1 = index 1, etc..
+*	Returns true if any bit is set.
+*/
+bool DS18B20Multidrop::NewAlarms(
+	const uint8_t*	inIgnoreBits,
+	uint8_t*		outNewAlarmBits) const
+{
+	uint8_t	anyAlarms = 0;
+	uint8_t	bitsetSize = BitsetSize(mCapacity);
+	for (uint8_t i = 0; i < bitsetSize; i++)
+	{
+		uint8_t	newAlarms = mAlarm ? mAlarmBits[i] : 0;
+		if (inIgnoreBits)
+		{
+			newAlarms &= ~inIgnoreBits[i];
+		}
+		outNewAlarmBits[i] = newAlarms;
+		anyAlarms |= newAlarms;
+	}
+	return(anyAlarms != 0);
+}
+
+/******************************* ReadScratchPad *******************************/
+/*
+*	Reads the first inLength bytes of the scratch pad.  The reset following the
+*	read terminates the transfer.  If the full scratch pad is read, false is
+*	returned if the CRC doesn't match.
+*/
+bool DS18B20Multidrop::ReadScratchPad(
+	uint8_t			inIndex,
+	DSScratchPad&	outScratchPad,
+	uint8_t			inLength)
+{
+	OneWire&	oneWire = Bus(inIndex);
+	uint8_t	success = oneWire.reset();
 	if (success)
 	{
-		mOneWire.select(mThermometer[inIndex].address);
-		mOneWire.write(eReadScratchPad);
-		mOneWire.read_bytes(outScratchPad.data, 9);
-		success = mOneWire.reset();
+		oneWire.select(mAddress[inIndex]);
+		oneWire.write(eReadScratchPad);
+		oneWire.read_bytes(outScratchPad.data, inLength);
+		success = oneWire.reset();
+		if (success &&
+			inLength == sizeof(DSScratchPad) &&
+			OneWire::crc8(outScratchPad.data, 8) != outScratchPad.f.crc)
+		{
+			mCRCFailures++;
+			Increment(mInfo[inIndex].crcErrors);
+			return(false);
+		}
+	}
+	if (!success)
+	{
+		Increment(mInfo[inIndex].presenceFailures);
 	}
 	return(success);
 }
@@ -314,25 +1894,65 @@ bool DS18B20Multidrop::WriteScratchPad(
 	DSScratchPad&	inScratchPad,
 	bool			inSaveToEEPROM)
 {
-	uint8_t	success = mOneWire.reset();
+	OneWire&	oneWire = Bus(inIndex);
+	uint8_t	success = oneWire.reset();
 	if (success)
 	{
-		mOneWire.select(mThermometer[inIndex].address);
-		mOneWire.write(eWriteScratchPad);
-		mOneWire.write_bytes(&inScratchPad.data[2], 3);
-		success = mOneWire.reset();
+		oneWire.select(mAddress[inIndex]);
+		oneWire.write(eWriteScratchPad);
+		oneWire.write_bytes(&inScratchPad.data[2], 3);
+		success = oneWire.reset();
 		if (success && inSaveToEEPROM)
 		{
-			mOneWire.select(mThermometer[inIndex].address);
-			mOneWire.write(eCopyScratchPad);
+			oneWire.select(mAddress[inIndex]);
+			// Parasite powered thermometers need the strong pullup to write
+			oneWire.write(eCopyScratchPad, IsParasitePowered(mInfo[inIndex].bus));
 			// Per doc, don't reset till the EEPROM write completes (Max 10ms)
 			delay(10);
-			mOneWire.reset();
+			oneWire.reset();
 		}
 	}
 	return(success);
 }
 
+/************************************ CToF ************************************/
+/*
+*	Results that don't fit in 16 bits (above ~1100C or below ~-1150C) are
+*	clamped.
+*/
+int16_t DS18B20Multidrop::CToF(
+	int16_t	inTempC)
+{
+	return(ClampToInt16(NineFifths(inTempC) + (32*16)));
+}
+
+/********************************* CToFDelta **********************************/
+/*
+*	A difference or rate is scaled without the 32F offset.  Results that don't
+*	fit in 16 bits are clamped.
+*/
+int16_t DS18B20Multidrop::CToFDelta(
+	int16_t	inDeltaC)
+{
+	return(ClampToInt16(NineFifths(inDeltaC)));
+}
+
+/********************************* NineFifths *********************************/
+/*
+*	Same result as (inValue * 9) / 5 in 32 bits (truncated toward zero) but
+*	without a division, which the AVR doesn't have an instruction for.  For
+*	the magnitude a, 9a/5 = 2a - ceil(a/5), and for a 16 bit numerator n,
+*	n/5 = (n * 0xCCCD) >> 18 exactly.
+*/
+int32_t DS18B20Multidrop::NineFifths(
+	int16_t	inValue)
+{
+	uint16_t	magnitude = inValue < 0 ? -(uint16_t)inValue : inValue;	// 0 to 32768
+	uint32_t	fifth = ((uint32_t)(magnitude + 4) * 0xCCCD) >> 18;
+	int32_t	scaled = ((uint32_t)magnitude * 2) - fifth;
+	return(inValue < 0 ? -scaled : scaled);
+}
+
 /******************************* CreateTempStr ********************************/
 uint8_t DS18B20Multidrop::CreateTempStr(
 	uint8_t	inIndex,
@@ -341,7 +1961,7 @@ uint8_t DS18B20Multidrop::CreateTempStr(
 	bool	inUse7Bit,
 	char*	outTempStr)
 {
-	uint8_t	charsBeforeDec = CreateTempStr(mThermometer[inIndex].temp, inCelsius, inAppendUnitSuffix, inUse7Bit, outTempStr);
+	uint8_t	charsBeforeDec = CreateTempStr(mTemp[inIndex], inCelsius, inAppendUnitSuffix, inUse7Bit, outTempStr);
 	return(charsBeforeDec);
 }
 
@@ -24,13 +24,16 @@
 #define DS18B20Multidrop_h
 
 #include <inttypes.h>
+#include <avr/pgmspace.h>
 #include "MSPeriod.h"
+#include "ScheduledSensor.h"
 
 class OneWire;
+class OneWireAsync;
 
 //#define DUMP_TO_SERIAL 1
 
-#define MAX_DS18B20_COUNT	4	// (if more than 8 then update NewAlarms())
+#define DS18B20_MAX_BUSES	4
 
 typedef uint8_t OneWireDevAddr[8];
 typedef uint8_t DS18B20ScratchPad[9];
@@ -51,15 +54,47 @@ union DSScratchPad
 	
 };
 
-struct SDS18B20
+/*
+*	Per thermometer information that isn't needed on every update.
+*	The bus health counters saturate at 255.
+*/
+struct SDS18B20Info
+{
+	uint8_t	bus;				// Index of the bus the thermometer is on
+	uint8_t	interval;			// Update cycles between reads, see SetAdaptiveSampling
+	uint8_t	countdown;			// Update cycles till the next read, 0 = due
+	uint8_t	crcErrors;
+	uint8_t	presenceFailures;	// No presence pulse on reset
+	uint8_t	retries;
+	uint8_t	powerOnReads;		// 85C power-on reset value rejected
+	uint8_t	refreshFailures;	// Consecutive refreshes without a response
+	uint8_t	family;				// DS18B20Multidrop::EFamily, set by begin()
+	uint8_t	resolution;			// Resolution read back from the thermometer
+	uint8_t	conversionTime;		// Measured conversion time, 4ms units
+	uint8_t	alarmCount;			// Consecutive readings beyond a limit
+	uint16_t	crossTime;		// millis()/256 at the conversion of alarmCount 1
+	int16_t	alarmHigh;			// Alarm limits, kNoAlarmLimit = use the
+	int16_t	alarmLow;			// DS18B20Multidrop alarm high/low
+	int32_t	trendLevel;			// EWMA of the temperature, 1/65536 C
+	int32_t	trendSlope;			// EWMA of the slope, 1/65536 C per update period
+};
+
+/*
+*	Per thermometer oversampling state, see SetOversampling.  Samples are
+*	accumulated relative to the first sample of the burst so that the sums fit
+*	in 16 bits.
+*/
+struct SDS18B20Filter
 {
-	uint8_t	address[8];
-	int16_t	temp;
-	bool	changed;
-	bool	alarm;
+	int16_t		value;		// Mean of the last burst, 1/256 C
+	uint16_t	variance;	// Of the samples of the last burst, 1/256 C^2
+	int16_t		first;		// First sample of the burst, 1/16 C
+	int16_t		sum;		// Sum of (sample - first)
+	uint16_t	sumSq;		// Sum of (sample - first)^2, see AccumulateSample
+	uint8_t		count;		// Samples in the burst so far
 };
 
-class DS18B20Multidrop
+class DS18B20Multidrop : public ScheduledSensor
 {
 public:
 	enum EResolution
@@ -70,23 +105,108 @@ public:
 		e12BitResolution	// 0.0625 C, 750 ms
 	};
 	/*
+	*	Families identified from the ROM pattern.  Genuine includes clones
+	*	that use the same ROM pattern (Family A in the counterfeit notes.)
+	*/
+	enum EFamily
+	{
+		eGenuineFamily,		// 28-xx-xx-xx-xx-00-00-crc
+		eCloneFamilyB,		// 28-xx-xx-xx-xx-xx-01-crc
+		eCloneFamilyC,		// 28-FF-xx-xx-xx-xx-xx-crc, fixed resolution
+		eUnknownFamily
+	};
+	/*
 	*	The alarm high/low values are fixed-point with a 1/16 scale. (low 4 bits
 	*	used for fraction.)
+	*
+	*	The per thermometer storage is supplied by the caller, normally
+	*	DS18B20MultidropN<N> (see below.)  The changed, alarm, valid and trend
+	*	states are packed bitsets, one bit per thermometer, of
+	*	BitsetSize(inCapacity) bytes each.  inInfo and inFilter are arrays of
+	*	inCapacity entries.
 	*/
 							DS18B20Multidrop(
 								OneWire&				inOneWire,
 								uint32_t				inUpdatePeriod,
-								int16_t					inAlarmHigh = 38*16,// 38C, ~100F
-								int16_t					inAlarmLow = 0,		// 0C, 32F
-								EResolution				inResolution = e9BitResolution);
+								int16_t					inAlarmHigh,
+								int16_t					inAlarmLow,
+								EResolution				inResolution,
+								uint8_t					inCapacity,
+								OneWireDevAddr*			inAddress,
+								int16_t*				inTemp,
+								uint8_t*				inChangedBits,
+								uint8_t*				inAlarmBits,
+								uint8_t*				inValidBits,
+								uint8_t*				inTrendBits,
+								SDS18B20Info*			inInfo,
+								SDS18B20Filter*			inFilter);
+	/*
+	*	Adds another 1-Wire bus (the constructor's OneWire is bus 0.)
+	*	Conversions run on all buses at the same time.  The thermometers are
+	*	indexed in bus order, then in search order within each bus.
+	*	Thermometers found by the background search are appended.  Must be
+	*	called before begin().  Returns false if there are already
+	*	DS18B20_MAX_BUSES buses.
+	*/
+	bool					AddBus(
+								OneWire&				inOneWire);
+	uint8_t					GetBusCount(void) const
+								{return(mBusCount);}
 	/*
-	*	Should be called on startup and whenever a thermometer is added or
-	*	removed from the 1-Wire bus.
+	*	Should be called on startup.  When a valid ROM cache is set (see
+	*	SetROMCache), the cached thermometers are verified by Refresh() rather
+	*	than searching the buses.  Otherwise a full search is performed and its
+	*	result is cached.
 	*/
 	void					begin(void);
+	/*
+	*	Verifies that each known thermometer is still present and reads its
+	*	scratch pad, keeping the readings of those present.  A thermometer
+	*	that doesn't respond is marked invalid, keeping its index and settings,
+	*	and is only removed after kMaxRefreshFailures consecutive refreshes
+	*	without a response.  A background search for thermometers that have
+	*	been added is started.  Call after waking rather than begin().  When
+	*	called while a conversion is in progress the refresh is deferred to
+	*	Update() after the conversion has been read.
+	*/
+	void					Refresh(void);
+	/*
+	*	The ROM cache is the list of known thermometer addresses saved to the
+	*	MCU's EEPROM at inEEPROMAddr, ROMCacheSize(GetCapacity()) bytes.  It's
+	*	updated whenever a thermometer is added or removed.  Pass 0 to disable
+	*	(the default.)  Must be called before begin().
+	*/
+	void					SetROMCache(
+								uint16_t				inEEPROMAddr)
+								{mROMCacheAddr = inEEPROMAddr;}
+	inline static uint16_t	ROMCacheSize(
+								uint8_t					inCapacity)
+								{return(1 + inCapacity * (5 + sizeof(OneWireDevAddr)));}
+							// True while the background search is in progress
+	bool					IsDiscovering(void) const
+								{return(mDiscoveryBus < mBusCount);}
 	
 	bool					Update(
 								bool					inResetAlarms);
+	/*
+	*	ScheduledSensor, one channel per thermometer.  Each Run() performs
+	*	one step of Update(false): polling or reading the conversion, a
+	*	deferred Refresh(), a background search pass, or starting the next
+	*	conversion.  Returns 0 while there are steps left so that it's run
+	*	every loop, otherwise the time till the next update.
+	*/
+	virtual uint32_t		Run(void);
+	virtual uint8_t			GetChannelCount(void) const
+								{return(mCount);}
+	virtual uint8_t			GetChannelType(
+								uint8_t					inChannel) const
+								{return(eTemperature);}
+	virtual int16_t			GetReading(
+								uint8_t					inChannel) const
+								{return(mTemp[inChannel]);}
+	virtual bool			ReadingIsValid(
+								uint8_t					inChannel) const
+								{return(IsValid(inChannel));}
 	bool					DataUpdated(
 								bool					inResetAlarms);
 	bool					BeginDataUpdate(void);
@@ -97,7 +217,7 @@ public:
 							// Returns true if the thermometer at inIndex has changed.
 	bool					TemperatureChanged(
 								uint8_t					inIndex) const
-								{return(mThermometer[inIndex].changed);}
+								{return(BitIsSet(mChangedBits, inIndex));}
 	void					ResetTemperatureChanged(void);
 	bool					DataIsValid(void) const
 								{return(mDataIsValid);}
@@ -106,44 +226,270 @@ public:
 							// Returns true if the alarm at inIndex is active.
 	bool					Alarm(
 								uint8_t					inIndex) const
-								{return(mThermometer[inIndex].alarm);}
-	uint8_t					NewAlarms(
-								uint8_t					inIgnoreMask);
+								{return(BitIsSet(mAlarmBits, inIndex));}
+							// Returns true if the thermometer at inIndex has
+							// been read at least once since begin().
+	bool					IsValid(
+								uint8_t					inIndex) const
+								{return(BitIsSet(mValidBits, inIndex));}
+	bool					NewAlarms(
+								const uint8_t*			inIgnoreBits,
+								uint8_t*				outNewAlarmBits) const;
 	void					ResetAlarm(void);
-							// Initiate readings of all thermometers (async)
-	inline bool				ConversionDone(void)
-								{return(mConversionPeriod.Passed());}
-	inline const SDS18B20*	GetThermometers(void) const
-								{return(mThermometer);}
+	/*
+	*	Alarm latency trace points (millis.)  Returns true once per alarm
+	*	raised, with the start of the conversion of the first reading beyond
+	*	the limit (256ms resolution) and the read of the reading that raised
+	*	the alarm.  ResetAlarmTrace discards a raise that won't be reported.
+	*/
+	bool					TakeAlarmTrace(
+								uint32_t&				outConversionStart,
+								uint32_t&				outRead);
+	void					ResetAlarmTrace(void)
+								{mAlarmTraced = false;}
+							// Returns true when the conversion started by
+							// BeginDataUpdate has completed.
+	bool					ConversionDone(void);
+	/*
+	*	The power mode of each bus is detected by begin() and Refresh().  On a
+	*	bus with any parasite powered thermometer the bus is held high (strong
+	*	pullup) for the conversion period, and the thermometers can't signal
+	*	completion so the conversion period is waited out.  Externally powered
+	*	buses are polled for completion.  SetParasitePower(true) treats all
+	*	buses as parasite powered from the next detection.
+	*/
+	void					SetParasitePower(
+								bool					inParasitePower)
+								{mParasitePower = inParasitePower;}
+	bool					IsParasitePowered(
+								uint8_t					inBus) const
+								{return((mParasiteBuses & _BV(inBus)) != 0);}
+							// Most recent and maximum measured conversion
+							// time in ms, the time for the slowest thermometer.
+	uint16_t				ConversionTime(void) const
+								{return(mConversionTime);}
+	uint16_t				MaxConversionTime(void) const
+								{return(mMaxConversionTime);}
+	/*
+	*	In alarm search mode the thermometers' TH/TL are programmed from the
+	*	alarm high/low and, after each conversion, only the thermometers found
+	*	by a 1-Wire alarm search (0xEC) are read.  Every inFullSweepCycles
+	*	updates all of the thermometers are read.  Pass 0 to disable.
+	*/
+	void					SetAlarmSearchMode(
+								uint8_t					inFullSweepCycles);
+							// Bus time in microseconds of the most recent
+							// full sweep and alarm search reads.
+	uint32_t				SweepBusTime(void) const
+								{return(mSweepBusTime);}
+	uint32_t				AlarmSearchBusTime(void) const
+								{return(mAlarmSearchBusTime);}
+	uint8_t					AlarmSearchHits(void) const
+								{return(mAlarmSearchHits);}
+	/*
+	*	In truncated read mode only the 2 temperature bytes of the scratch pad
+	*	are read.  Every inFullReadCycles updates, or when a reading differs
+	*	from the previous by more than inJumpThreshold (1/16 C), the full
+	*	scratch pad is read and its CRC checked.  Pass 0 to always read the
+	*	full scratch pad.
+	*/
+	void					SetTruncatedReads(
+								uint8_t					inFullReadCycles,
+								int16_t					inJumpThreshold = 2*16);
+	uint16_t				TruncatedReads(void) const
+								{return(mTruncatedReads);}
+							// Estimated bus time saved by truncated reads
+	uint32_t				TruncatedReadSavings(void) const
+								{return((uint32_t)mTruncatedReads * kTruncatedReadSavings);}
+	uint16_t				CRCFailures(void) const
+								{return(mCRCFailures);}
+	inline const SDS18B20Info&	GetInfo(
+								uint8_t					inIndex) const
+								{return(mInfo[inIndex]);}
+	void					ResetInfo(void);
+							// 'G', 'B', 'C' or '?', see EFamily
+	inline static char		FamilyChar(
+								uint8_t					inFamily)
+								{return(pgm_read_byte(&kFamilyChars[inFamily]));}
+	/*
+	*	Adaptive sampling reads each thermometer every 1 to inMaxInterval
+	*	update periods.  The interval doubles after each reading that changed
+	*	by less than inSlopeThreshold (1/16 C) per update period.  It drops to
+	*	1 when the slope is steeper, or the reading is within inNearThreshold of
+	*	the alarm high or low.  When no thermometer is due the conversion is
+	*	skipped, and when only some are due only those convert.
+	*	inMaxInterval of 1 (the default) reads every thermometer every update.
+	*/
+	void					SetAdaptiveSampling(
+								uint8_t					inMaxInterval,
+								int16_t					inSlopeThreshold = 4,	// 0.25C
+								int16_t					inNearThreshold = 2*16);
+	uint16_t				SkippedReads(void) const
+								{return(mSkippedReads);}
+	uint16_t				SkippedConversions(void) const
+								{return(mSkippedConversions);}
+	/*
+	*	When an async engine is set, full sweeps read the scratch pads using
+	*	it, one thermometer per transaction, and DataUpdated returns true once
+	*	all have been read.  The OneWire object is still used for everything
+	*	else.  The async engine must be on the pin of bus 0.  Thermometers on
+	*	other buses are read synchronously within the sweep.
+	*/
+	void					SetAsyncEngine(
+								OneWireAsync*			inAsync)
+								{mAsync = inAsync;}
+	OneWireAsync*			GetAsyncEngine(void) const
+								{return(mAsync);}
+	/*
+	*	In oversampling mode each update runs a burst of inSamples back to back
+	*	conversions (2 to kMaxOversamples, 1 = off.)  The mean of each
+	*	thermometer's burst is its reading, and the mean (1/256 C) and variance
+	*	of the samples are available from GetFilter.  Averaging fast 9 bit
+	*	conversions is more stable than a single 9 bit conversion, and at 4
+	*	samples takes ~half the time of a 12 bit conversion.
+	*
+	*	The full read (SetTruncatedReads) and full sweep (SetAlarmSearchMode)
+	*	cycles count conversions rather than updates.
+	*/
+	void					SetOversampling(
+								uint8_t					inSamples);
+	uint8_t					GetOversampling(void) const
+								{return(mOversamples);}
+	inline const SDS18B20Filter&	GetFilter(
+								uint8_t					inIndex) const
+								{return(mFilter[inIndex]);}
+							// Bus time in microseconds of the most recent
+							// burst (all conversions and reads.)
+	uint32_t				BurstTime(void) const
+								{return(mBurstTime);}
+	static const uint8_t	kMaxOversamples = 16;
+	inline int16_t			GetTemperature(
+								uint8_t					inIndex) const
+								{return(mTemp[inIndex]);}
+	inline const uint8_t*	GetAddress(
+								uint8_t					inIndex) const
+								{return(mAddress[inIndex]);}
 	inline const uint8_t	GetCount(void) const
 								{return(mCount);}
+	inline const uint8_t	GetCapacity(void) const
+								{return(mCapacity);}
+							// Bytes needed for a bitset of inCount bits.
+	inline static uint8_t	BitsetSize(
+								uint8_t					inCount)
+								{return((inCount+7)/8);}
+	inline static bool		BitIsSet(
+								const uint8_t*			inBits,
+								uint8_t					inIndex)
+								{return((inBits[inIndex/8] & _BV(inIndex & 7)) != 0);}
+	inline static void		SetBit(
+								uint8_t*				inBits,
+								uint8_t					inIndex)
+								{inBits[inIndex/8] |= _BV(inIndex & 7);}
+	inline static void		ClearBit(
+								uint8_t*				inBits,
+								uint8_t					inIndex)
+								{inBits[inIndex/8] &= ~_BV(inIndex & 7);}
 	void					SetUpdatePeriod(
-								uint32_t				inPeriod)
-								{mUpdatePeriod.Set(inPeriod);
-								mUpdatePeriod.Start();}
-	/*
-	*	SetAlarmHighLow is only an accessor.  If you need to set the value on
-	*	the thermometers then you should call begin() after calling this routine.
-	*	Note that this class doesn't use the high low value stored on the
-	*	thermometer itself but rather uses the high low members of this class.
-	*	Therefore there shouldn't be any reason to update the high low values
-	*	on the thermometers unless this class is modified or subclassed to
-	*	support individual termometer alarms.  (See DS18B20Multidrop::Update())
+								uint32_t				inPeriod);
+	uint32_t				GetUpdatePeriod(void) const
+								{return(mUpdatePeriod.Get());}
+							// Worst case update periods from a thermometer
+							// crossing a limit to its alarm being raised.
+	uint16_t				AlarmLatencyPeriods(void) const
+								{return(mMaxInterval + mAlarmConfirm - 1);}
+	/*
+	*	Note that the alarm state is determined using the high low members of
+	*	this class.  The high low values stored on the thermometers are only
+	*	used by the alarm search mode.  When changed, the values on the
+	*	thermometers are updated before the next conversion.
 	*/							
 	void					SetAlarmHigh(
 								int16_t					inAlarmHigh)
 							{
 								mAlarmHigh = inAlarmHigh;
+								mAlarmLimitsChanged = true;
 							}
 	void					SetAlarmLow(
 								int16_t					inAlarmLow)
 							{
 								mAlarmLow = inAlarmLow;
+								mAlarmLimitsChanged = true;
 							}
 	int16_t					GetAlarmHigh(void) const
 								{return(mAlarmHigh);}
 	int16_t					GetAlarmLow(void) const
 								{return(mAlarmLow);}
+	/*
+	*	Per thermometer alarm limits override the alarm high/low for the
+	*	thermometer at inIndex.  Pass kNoAlarmLimit to use the alarm high/low.
+	*	The limits are saved in the ROM cache along with the address so they
+	*	follow the thermometer when the indexes change.
+	*/
+	void					SetAlarmHigh(
+								uint8_t					inIndex,
+								int16_t					inAlarmHigh);
+	void					SetAlarmLow(
+								uint8_t					inIndex,
+								int16_t					inAlarmLow);
+	void					ClearAlarmLimits(
+								bool					inHigh = true,
+								bool					inLow = true);
+							// Returns the limit in effect for inIndex
+	inline int16_t			GetAlarmHigh(
+								uint8_t					inIndex) const
+								{return(inIndex < mCount &&
+									mInfo[inIndex].alarmHigh != kNoAlarmLimit ?
+										mInfo[inIndex].alarmHigh : mAlarmHigh);}
+	inline int16_t			GetAlarmLow(
+								uint8_t					inIndex) const
+								{return(inIndex < mCount &&
+									mInfo[inIndex].alarmLow != kNoAlarmLimit ?
+										mInfo[inIndex].alarmLow : mAlarmLow);}
+	/*
+	*	An alarm is raised after inConfirmReadings consecutive readings at or
+	*	beyond a limit.  It's cleared by a reading more than inHysteresis
+	*	(1/16 C) inside both limits.  When inLatch is true an alarm stays raised
+	*	till ResetAlarm() is called.  With the defaults (0, 1, false) an alarm
+	*	clears as soon as a reading is back within the limits.
+	*/
+	void					SetAlarmFilter(
+								int16_t					inHysteresis,
+								uint8_t					inConfirmReadings = 1,
+								bool					inLatch = false);
+	static const int16_t	kNoAlarmLimit = -32768;
+	/*
+	*	Each thermometer keeps an EWMA of its temperature and of its slope
+	*	(double exponential smoothing, O(1) per reading.)  A trend alarm is
+	*	raised when a thermometer is heading toward its alarm high or low at
+	*	inMinSlope (1/16 C per hour) or faster, and at that rate will reach it
+	*	in less than inHorizon minutes.  Trend alarms are separate from the
+	*	threshold alarms and clear as soon as the projection no longer applies.
+	*	Pass 0 for inHorizon to disable (the default.)
+	*
+	*	The slope assumes each thermometer is read every interval update
+	*	periods (see SetAdaptiveSampling) so it's meaningless in alarm search
+	*	mode.
+	*/
+	void					SetTrendAlarm(
+								uint16_t				inHorizon,
+								int16_t					inMinSlope = 16);	// 1C/h
+	bool					TrendAlarm(void) const;
+							// Returns true if the trend alarm at inIndex is active.
+	bool					TrendAlarm(
+								uint8_t					inIndex) const
+								{return(BitIsSet(mTrendBits, inIndex));}
+							// Smoothed slope in 1/16 C per hour
+	int16_t					GetSlope(
+								uint8_t					inIndex) const;
+							// Projected minutes till the alarm high or low is
+							// reached, kNoTimeToAlarm if not heading toward one
+							// at the minimum slope or faster.
+	uint16_t				GetTimeToAlarm(
+								uint8_t					inIndex) const;
+	static const uint16_t	kNoTimeToAlarm = 0xFFFF;
+							// Restarts the smoothing, call when the time since
+							// the last reading is unknown (e.g. MCU sleep.)
+	void					ResetTrend(void);
 								
 	uint8_t					CreateTempStr(
 								uint8_t					inIndex,
@@ -157,28 +503,110 @@ public:
 								bool					inAppendUnitSuffix,
 								bool					inUse7Bit,
 								char*					outTempStr);
-	// Fixed-point conversion to F uses unscaled multipiers and divisors so the
-	// result is the same 1/16 scale, then 32 is added scaled to 1/16.
-	inline static int16_t	CToF(
-								int16_t					inTempC)
-								{return(((inTempC * 9) / 5) + (32*16));}
+	// Fixed-point conversion to F, the result is the same 1/16 scale.  CToF
+	// is exact without dividing, FToC uses unscaled multipiers and divisors.
+	static int16_t			CToF(
+								int16_t					inTempC);
+							// For a temperature difference or rate (no 32F
+							// offset.)
+	static int16_t			CToFDelta(
+								int16_t					inDeltaC);
 	inline static int16_t	FToC(
 								int16_t					inTempF)
 								{return(((inTempF - (32*16)) * 5) / 9);}
 								
 	static const char kDegCelsiusStr[];
 	static const char kDegFahrenheitStr[];
+	static const char kFamilyChars[];
 protected:
-	OneWire&	mOneWire;
+	OneWire*	mBus[DS18B20_MAX_BUSES];
+	uint8_t		mBusCount;
+	uint8_t		mConvertingBuses;	// Bit per bus, cleared when done
 	MSPeriod	mConversionPeriod;
 	MSPeriod	mUpdatePeriod;
-	SDS18B20	mThermometer[MAX_DS18B20_COUNT];
+	/*
+	*	Structure of arrays, each mCapacity entries (bitsets mCapacity bits.)
+	*/
+	OneWireDevAddr*	mAddress;
+	int16_t*	mTemp;
+	uint8_t*	mChangedBits;
+	uint8_t*	mAlarmBits;
+	uint8_t*	mValidBits;
+	uint8_t*	mTrendBits;
+	SDS18B20Info*	mInfo;
+	SDS18B20Filter*	mFilter;
+	uint8_t		mOversamples;		// Conversions per burst, 1 = off
+	uint8_t		mBurstRemaining;	// Conversions still to start in this burst
+	bool		mSampling;			// Readings are accumulated (burst in progress)
+	uint32_t	mBurstStartTime;
+	uint32_t	mBurstTime;
+	OneWireAsync*	mAsync;
+	uint8_t		mAsyncIndex;	// Thermometer being read, >= mCount when idle
+	uint8_t		mAsyncAttempt;
+	uint8_t		mAsyncLength;	// Bytes being read
+	uint32_t	mSweepStartTime;
+	uint8_t		mMaxInterval;
+	int16_t		mSlopeThreshold;
+	int16_t		mNearThreshold;
+	uint16_t	mSkippedReads;
+	uint16_t	mSkippedConversions;
+	DSScratchPad	mAsyncScratchPad;
 	int16_t		mAlarmHigh;
 	int16_t		mAlarmLow;
 	bool		mAlarm;
 	bool		mTemperatureChanged;
 	bool		mDataIsValid;
+	bool		mParasitePower;		// Force parasite power on all buses
+	uint8_t		mParasiteBuses;		// Bit per bus, see DetectPowerMode
+	bool		mAlarmLimitsChanged;
+	uint8_t		mFullSweepCycles;	// 0 = alarm search mode off
+	uint8_t		mSweepCountdown;
+	uint8_t		mAlarmSearchHits;
+	uint32_t	mSweepBusTime;
+	uint32_t	mAlarmSearchBusTime;
+	uint8_t		mFullReadCycles;	// 0 = truncated reads off
+	uint8_t		mFullReadCountdown;
+	bool		mFullRead;			// This update reads full scratch pads
+	int16_t		mJumpThreshold;
+	uint16_t	mTruncatedReads;
+	uint16_t	mCRCFailures;
+	uint16_t	mROMCacheAddr;		// 0 = no ROM cache
+	int16_t		mAlarmHysteresis;
+	uint8_t		mAlarmConfirm;		// Readings needed to raise an alarm
+	bool		mAlarmLatch;
+	uint8_t		mDiscoveryBus;		// Bus being searched, >= mBusCount when idle
+	bool		mDiscoveryDue;		// Run() step, a search pass this update
+	bool		mRefreshing;		// Rereading the last conversion, see Refresh
+	bool		mRefreshPending;	// Refresh deferred till the conversion is read
+	bool		mAlarmTraced;		// An alarm raise is waiting, see TakeAlarmTrace
+	uint32_t	mConversionStartTime;	// millis() at BeginDataUpdate
+	uint32_t	mAlarmTraceStart;
+	uint32_t	mAlarmTraceRead;
+	uint16_t	mTrendHorizon;		// Minutes, 0 = trend alarms off
+	int16_t		mTrendMinSlope;		// 1/16 C per hour
+	uint16_t	mTrendPeriods;		// mTrendHorizon in update periods
+	int32_t		mTrendMinRate;		// mTrendMinSlope in trendSlope units, >= 1
+	// 7 bytes not read * 8 read slots * ~70us per slot
+	static const uint16_t	kTruncatedReadSavings = 7*8*70;
+	static const uint8_t	kMaxReadRetries = 2;
+	static const uint8_t	kMaxRefreshFailures = 3;
+	static const int16_t	kPowerOnTemp = 85*16;	// Scratch pad value after power-on
+	static const int16_t	kPowerOnTempWindow = 2*16;
+	static const uint16_t	kMaxConversionTime = 800;	// ms, 12 bit is 750
+	static const int32_t	kNoTrend = -2147483647L - 1;	// trendLevel not set
+	static const uint8_t	kTrendLevelShift = 3;	// Level EWMA weight 1/8
+	static const uint8_t	kTrendSlopeShift = 6;	// Slope EWMA weight 1/64
+	
+	inline OneWire&			Bus(
+								uint8_t					inIndex) const
+								{return(*mBus[mInfo[inIndex].bus]);}
+	inline static void		Increment(
+								uint8_t&				ioCount)
+								{if (ioCount < 0xFF) ioCount++;}
+	uint16_t	mConversionTime;
+	uint16_t	mMaxConversionTime;
 	uint8_t		mCount;
+	uint8_t		mCapacity;
 	uint8_t		mResolution;
 
 	enum ECommandSet
@@ -193,10 +621,103 @@ protected:
 	
 	bool					ReadScratchPad(
 								uint8_t					inIndex,
-								DSScratchPad&			outScratchPad);
+								DSScratchPad&			outScratchPad,
+								uint8_t					inLength = sizeof(DSScratchPad));
+	void					UpdateThermometer(
+								uint8_t					inIndex);
+	void					CheckAlarm(
+								uint8_t					inIndex);
+	void					RestoreAlarm(
+								uint8_t					inIndex);
+	void					UpdateAlarm(void);
+	void					UpdateTrend(
+								uint8_t					inIndex,
+								int16_t					inTemp);
+	void					CheckTrend(
+								uint8_t					inIndex);
+	uint16_t				PeriodsToAlarm(
+								uint8_t					inIndex) const;
+	void					ScaleTrendLimits(void);
+	void					AdaptInterval(
+								uint8_t					inIndex,
+								int16_t					inChange);
+	void					ApplyReading(
+								uint8_t					inIndex,
+								const DSScratchPad&		inScratchPad);
+	void					SetReading(
+								uint8_t					inIndex,
+								int16_t					inTemp);
+	void					AccumulateSample(
+								uint8_t					inIndex,
+								int16_t					inTemp);
+	bool					SampleDone(void);
+	void					FinishBurst(void);
+	bool					StartConversion(void);
+	bool					StartAsyncRead(
+								uint8_t					inLength);
+	bool					StartNextAsyncRead(void);
+	bool					ContinueAsyncSweep(void);
+	void					ReadAlarmingThermometers(void);
+	void					DetectPowerMode(void);
+	static int32_t			NineFifths(
+								int16_t					inValue);
+	inline static int16_t	ClampToInt16(
+								int32_t					inValue)
+								{return(inValue > 32767 ? 32767 :
+									(inValue < -32768 ? -32768 : inValue));}
+	void					Fingerprint(
+								uint8_t					inIndex,
+								bool					inMeasure = true);
+	uint16_t				ConversionPeriod(
+								uint8_t					inIndex) const;
+	void					DiscoveryStep(void);
+	void					AddThermometer(
+								uint8_t					inBus,
+								const uint8_t*			inAddress);
+	void					RemoveThermometer(
+								uint8_t					inIndex);
+	uint8_t					LoadROMCache(void);
+	void					SaveROMCache(void);
+	void					ConfigScratchPad(
+								uint8_t					inIndex,
+								DSScratchPad&			outScratchPad) const;
+	uint8_t					FindThermometer(
+								const uint8_t*			inAddress) const;
+	bool					WriteConfig(void);
 	bool					WriteScratchPad(
 								uint8_t					inIndex,
 								DSScratchPad&			inScratchPad,
 								bool					inSaveToEEPROM);
 };
+
+/*
+*	DS18B20MultidropN owns the storage for up to N thermometers.  SRAM used
+*	is 47 bytes per thermometer plus 4 bits for the state bitsets.
+*/
+template<uint8_t N>
+class DS18B20MultidropN : public DS18B20Multidrop
+{
+public:
+							DS18B20MultidropN(
+								OneWire&				inOneWire,
+								uint32_t				inUpdatePeriod,
+								int16_t					inAlarmHigh = 38*16,// 38C, ~100F
+								int16_t					inAlarmLow = 0,		// 0C, 32F
+								EResolution				inResolution = e9BitResolution)
+								: DS18B20Multidrop(inOneWire, inUpdatePeriod,
+									inAlarmHigh, inAlarmLow, inResolution, N,
+									mAddressStore, mTempStore, mChangedStore,
+									mAlarmStore, mValidStore, mTrendStore,
+									mInfoStore, mFilterStore){}
+protected:
+	static_assert(N > 0 && N <= 99, "CreateIndexedTempStr supports 2 digit indexes");
+	OneWireDevAddr	mAddressStore[N];
+	int16_t			mTempStore[N];
+	uint8_t			mChangedStore[(N+7)/8];
+	uint8_t			mAlarmStore[(N+7)/8];
+	uint8_t			mValidStore[(N+7)/8];
+	uint8_t			mTrendStore[(N+7)/8];
+	SDS18B20Info	mInfoStore[N];
+	SDS18B20Filter	mFilterStore[N];
+};
 #endif // DS18B20Multidrop_h
@@ -29,7 +29,7 @@
 /********************************** DS3231SN **********************************/
 DS3231SN::DS3231SN(
 	uint8_t	inDeviceAddress)
-	: mDeviceAddress(inDeviceAddress)
+	: mDeviceAddress(inDeviceAddress), mTemperature(0), mTempIsValid(false)
 {
 }
 
@@ -87,3 +87,35 @@ void DS3231SN::GetTime(
 		}
 	}
 }
+
+/****************************** ReadTemperature *******************************/
+/*
+*	The temperature registers are a 10 bit two's complement value, the MSB
+*	the integer part and the upper 2 bits of the LSB the fraction.  As a 16 bit
+*	value it's 1/256 scale.
+*/
+bool DS3231SN::ReadTemperature(void)
+{
+	Wire.beginTransmission(mDeviceAddress);
+	Wire.write(eTempMSBReg);
+	Wire.endTransmission(true);
+	bool	success = Wire.requestFrom(mDeviceAddress, (uint8_t)2, (uint8_t)true) == 2;
+	if (success)
+	{
+		uint16_t	temp = (uint16_t)Wire.read() << 8;
+		temp |= Wire.read();
+		mTemperature = (int16_t)temp >> 4;
+		mTempIsValid = true;
+	}
+	return(success);
+}
+
+/************************************ Run *************************************/
+uint32_t DS3231SN::Run(void)
+{
+	if (ReadTemperature())
+	{
+		mNewReading = true;
+	}
+	return(kTempPeriod);
+}
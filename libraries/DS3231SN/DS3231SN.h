@@ -24,6 +24,8 @@
 #ifndef DS3231SN_H
 #define DS3231SN_H
 
+#include "ScheduledSensor.h"
+
 union DSDateTime
 {
 	struct
@@ -39,7 +41,7 @@ union DSDateTime
 	uint8_t	da[7];
 };
 
-class DS3231SN
+class DS3231SN : public ScheduledSensor
 {
 public:
 							DS3231SN(
@@ -50,8 +52,36 @@ public:
 								DSDateTime&				inDateAndTime) const;
 	void					GetTime(
 								DSDateTime&				inDateAndTime) const;
+	/*
+	*	The die temperature has a 0.25C resolution and is converted by the
+	*	DS3231 every 64 seconds.  It's a reference for the ambient temperature
+	*	of the enclosure.
+	*/
+	bool					ReadTemperature(void);
+							// 1/16 C, same scale as DS18B20Multidrop
+	int16_t					GetTemperature(void) const
+								{return(mTemperature);}
+	/*
+	*	ScheduledSensor, one temperature channel.  Each Run() reads the
+	*	temperature (one I2C transaction.)
+	*/
+	virtual uint32_t		Run(void);
+	virtual uint8_t			GetChannelCount(void) const
+								{return(1);}
+	virtual uint8_t			GetChannelType(
+								uint8_t					inChannel) const
+								{return(eTemperature);}
+	virtual int16_t			GetReading(
+								uint8_t					inChannel) const
+								{return(mTemperature);}
+	virtual bool			ReadingIsValid(
+								uint8_t					inChannel) const
+								{return(mTempIsValid);}
 protected:
 	uint8_t		mDeviceAddress;
+	int16_t		mTemperature;
+	bool		mTempIsValid;
+	static const uint32_t	kTempPeriod = 64000;	// ms, DS3231 conversion rate
 
 enum ERegAddr
 {
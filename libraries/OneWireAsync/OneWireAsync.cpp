@@ -0,0 +1,237 @@
+/*
+*	OneWireAsync.cpp, Copyright (c) 2022 Jonathan Mackey
+*	Interrupt driven 1-Wire master.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "OneWireAsync.h"
+#include <util/delay.h>
+
+OneWireAsync*	OneWireAsync::sInstance;
+
+/******************************** OneWireAsync ********************************/
+OneWireAsync::OneWireAsync(
+	uint8_t	inPin)
+	: mStatus(eIdle), mMaxMaskedTime(0)
+{
+	mBitMask = digitalPinToBitMask(inPin);
+	uint8_t	port = digitalPinToPort(inPin);
+	mModeReg = portModeRegister(port);
+	mInReg = portInputRegister(port);
+	mOutReg = portOutputRegister(port);
+	sInstance = this;
+}
+
+/*********************************** begin ************************************/
+/*
+*	The bus is driven low by making the pin an output with the port bit low,
+*	and released by making it an input (the external pull-up pulls it high.)
+*/
+void OneWireAsync::begin(void)
+{
+	cli();
+	Release();
+	*mOutReg &= ~mBitMask;		// No internal pull-up
+	TIMSK1 &= ~_BV(OCIE1A);
+	TCCR1A = 0;					// Normal mode
+	TCCR1B = _BV(CS11);			// clk/8 = 1us per tick at 8MHz
+	sei();
+}
+
+/****************************** StartTransaction ******************************/
+bool OneWireAsync::StartTransaction(
+	const uint8_t*	inWriteData,
+	uint8_t			inWriteLen,
+	uint8_t*		outReadData,
+	uint8_t			inReadLen,
+	bool			inResetAfter)
+{
+	bool	started = mStatus != eBusy && inWriteLen <= ONE_WIRE_ASYNC_TX_SIZE;
+	if (started)
+	{
+		memcpy(mTxData, inWriteData, inWriteLen);
+		mTxLen = inWriteLen;
+		mRxData = outReadData;
+		mRxLen = inReadLen;
+		memset(outReadData, 0, inReadLen);
+		mResetAfter = inResetAfter;
+		mByteIndex = 0;
+		mBitIndex = 0;
+		mStatus = eBusy;
+		cli();
+		DriveLow();				// Reset pulse, 480us min
+		mState = eResetRelease;
+		Schedule(480);
+		sei();
+	}
+	return(started);
+}
+
+/*********************************** Abort ************************************/
+void OneWireAsync::Abort(void)
+{
+	if (mStatus == eBusy)
+	{
+		cli();
+		Stop(eIdle);
+		sei();
+	}
+}
+
+/********************************** Schedule **********************************/
+/*
+*	Called with interrupts disabled.
+*/
+void OneWireAsync::Schedule(
+	uint16_t	inMicroseconds)
+{
+	OCR1A = TCNT1 + inMicroseconds;
+	TIFR1 = _BV(OCF1A);			// Clear any pending compare match
+	TIMSK1 |= _BV(OCIE1A);
+}
+
+/************************************ Stop ************************************/
+void OneWireAsync::Stop(
+	uint8_t	inStatus)
+{
+	TIMSK1 &= ~_BV(OCIE1A);
+	Release();
+	mStatus = inStatus;
+}
+
+/********************************** NextBit ***********************************/
+/*
+*	After the last bit of the last byte the state changes to the final reset,
+*	or completion.
+*/
+void OneWireAsync::NextBit(void)
+{
+	if (++mBitIndex == 8)
+	{
+		mBitIndex = 0;
+		mByteIndex++;
+		if (mByteIndex == mTxLen + mRxLen)
+		{
+			mState = mResetAfter ? eFinalReset : eComplete;
+		}
+	}
+}
+
+/******************************** HandleTimer *********************************/
+/*
+*	Called from the Timer1 compare A ISR.  Each call performs one phase of a
+*	reset or time slot and schedules the next.
+*
+*	Write 1: low 6us, release, recover 64us.
+*	Write 0: low 60us (timer), release, recover 10us.
+*	Read:    low 6us, release, sample at 15us, recover 55us.
+*/
+void OneWireAsync::HandleTimer(void)
+{
+	uint16_t	startTime = TCNT1;
+	switch (mState)
+	{
+		case eResetRelease:
+			Release();
+			mState = eResetSample;
+			Schedule(70);
+			break;
+		case eResetSample:
+			if (ReadPin())
+			{
+				Stop(eNoPresence);	// No device pulled the bus low
+				break;
+			}
+			mState = eResetRecovery;
+			Schedule(410);
+			break;
+		case eResetRecovery:
+			if (mTxLen + mRxLen == 0)
+			{
+				Stop(eDone);
+				break;
+			}
+			mState = eSlot;
+			// fall through
+		case eSlot:
+		{
+			uint8_t	bitMask = _BV(mBitIndex);
+			uint16_t	recovery;
+			if (mByteIndex < mTxLen)
+			{
+				DriveLow();
+				if (mTxData[mByteIndex] & bitMask)
+				{
+					_delay_us(6);
+					Release();
+					recovery = 64;
+				} else
+				{
+					mState = eWriteZeroRelease;
+					Schedule(60);
+					break;
+				}
+			} else
+			{
+				DriveLow();
+				_delay_us(6);
+				Release();
+				_delay_us(9);
+				if (ReadPin())
+				{
+					mRxData[mByteIndex - mTxLen] |= bitMask;
+				}
+				recovery = 55;
+			}
+			NextBit();
+			Schedule(recovery);
+			break;
+		}
+		case eWriteZeroRelease:
+			Release();
+			mState = eSlot;
+			NextBit();
+			Schedule(10);
+			break;
+		case eFinalReset:
+			DriveLow();
+			mState = eFinalResetRelease;
+			Schedule(480);
+			break;
+		case eFinalResetRelease:
+			Release();
+			mState = eComplete;
+			Schedule(480);	// Presence and recovery
+			break;
+		case eComplete:
+			Stop(eDone);
+			break;
+	}
+	uint16_t	maskedTime = TCNT1 - startTime;
+	if (maskedTime > mMaxMaskedTime)
+	{
+		mMaxMaskedTime = maskedTime > 0xFF ? 0xFF : maskedTime;
+	}
+}
+
+/**************************** Timer/Counter1 CompA ****************************/
+ISR(TIMER1_COMPA_vect)
+{
+	OneWireAsync::sInstance->HandleTimer();
+}
@@ -0,0 +1,117 @@
+/*
+*	OneWireAsync.h, Copyright (c) 2022 Jonathan Mackey
+*	Interrupt driven 1-Wire master.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef OneWireAsync_h
+#define OneWireAsync_h
+
+#include <Arduino.h>
+
+#define ONE_WIRE_ASYNC_TX_SIZE	10	// Reset + ROM select + command = 10 bytes
+
+/*
+*	The OneWire library bit-bangs each time slot with interrupts disabled.  A
+*	reset masks interrupts for ~1ms.  This class performs a 1-Wire transaction
+*	(reset, write bytes, read bytes, optional terminating reset) from the
+*	Timer1 compare A interrupt.  The long phases of a slot (reset low, recovery)
+*	are timed by the timer, so interrupts are only masked for the duration of
+*	the short low pulse and sample of a slot (~20us max.)
+*
+*	Timer1 runs at 1us per tick (8MHz/8 prescale.)  Only one instance is
+*	supported.  The OneWire library can share the same pin as long as it isn't
+*	used while a transaction is in progress.
+*/
+class OneWireAsync
+{
+public:
+	enum EStatus
+	{
+		eIdle,
+		eBusy,
+		eDone,
+		eNoPresence
+	};
+							OneWireAsync(
+								uint8_t					inPin);
+	void					begin(void);
+	/*
+	*	Starts a transaction.  inWriteData is copied.  outReadData must remain
+	*	valid till the transaction completes.  Returns false if busy.
+	*/
+	bool					StartTransaction(
+								const uint8_t*			inWriteData,
+								uint8_t					inWriteLen,
+								uint8_t*				outReadData,
+								uint8_t					inReadLen,
+								bool					inResetAfter = true);
+	bool					IsBusy(void) const
+								{return(mStatus == eBusy);}
+	uint8_t					Status(void) const
+								{return(mStatus);}
+	void					Abort(void);
+							// Longest time in the ISR (interrupts masked) in us
+	uint8_t					MaxMaskedTime(void) const
+								{return(mMaxMaskedTime);}
+	void					ResetMaxMaskedTime(void)
+								{mMaxMaskedTime = 0;}
+	void					HandleTimer(void);
+	static OneWireAsync*	sInstance;
+protected:
+	enum EState
+	{
+		eResetRelease,
+		eResetSample,
+		eResetRecovery,
+		eSlot,
+		eWriteZeroRelease,
+		eFinalReset,
+		eFinalResetRelease,
+		eComplete
+	};
+	volatile uint8_t*	mModeReg;
+	volatile uint8_t*	mInReg;
+	volatile uint8_t*	mOutReg;
+	uint8_t		mBitMask;
+	volatile uint8_t	mStatus;
+	uint8_t		mState;
+	uint8_t		mTxData[ONE_WIRE_ASYNC_TX_SIZE];
+	uint8_t		mTxLen;
+	uint8_t*	mRxData;
+	uint8_t		mRxLen;
+	uint8_t		mByteIndex;	// Tx bytes followed by Rx bytes
+	uint8_t		mBitIndex;
+	uint8_t		mMaxMaskedTime;
+	bool		mResetAfter;
+
+	inline void				DriveLow(void)
+								{*mModeReg |= mBitMask;}
+	inline void				Release(void)
+								{*mModeReg &= ~mBitMask;}
+	inline bool				ReadPin(void) const
+								{return((*mInReg & mBitMask) != 0);}
+	void					Schedule(
+								uint16_t				inMicroseconds);
+	void					Stop(
+								uint8_t					inStatus);
+	void					NextBit(void);
+};
+
+#endif // OneWireAsync_h
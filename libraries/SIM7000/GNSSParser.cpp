@@ -0,0 +1,255 @@
+/*
+*	GNSSParser.cpp
+*	Copyright (c) 2022 Jonathan Mackey
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*/
+#include "GNSSParser.h"
+#ifndef __MACH__
+#include <Arduino.h>
+#else
+#include <string.h>
+#define PSTR(xx) xx
+#define strcpy_P strcpy
+#endif
+
+/*
+*	+CGNSINF: <GNSS run status>,<Fix status>,<UTC date & Time>,<Latitude>,
+*	<Longitude>,<MSL Altitude>,<Speed Over Ground>,<Course Over Ground>,
+*	<Fix Mode>,<Reserved1>,<HDOP>,<PDOP>,<VDOP>,<Reserved2>,
+*	<GNSS Satellites in View>,<GNSS Satellites Used>,...
+*
+*	Ex: 1,1,20220817182243.000,42.123456,-71.123456,52.300,0.00,0.0,1,,1.1,1.4,0.9,,12,8,,,38,,
+*/
+const uint8_t	kCoordinateDecimals = 6;
+
+/********************************* GNSSParser *********************************/
+GNSSParser::GNSSParser(void)
+	: mIsRunning(false), mHasFix(false)
+{
+	Reset();
+}
+
+/*********************************** Reset ************************************/
+/*
+*	Prepares for the start of a new response.  The last fix is retained.
+*/
+void GNSSParser::Reset(void)
+{
+	memset(&mWork, 0, sizeof(SGNSSFix));
+	mField = eRunStatusField;
+	mValue = 0;
+	mDigits = 0;
+	mDecimals = 0;
+	mNegative = false;
+	mInFraction = false;
+	mRunStatus = false;
+	mFixStatus = false;
+	strcpy_P(mDateTimeStr, PSTR("00/00/00,00:00:00"));
+}
+
+/*********************************** Parse ************************************/
+/*
+*	Parses a nul terminated +CGNSINF parameter string.
+*	Returns true if a valid fix was parsed.
+*/
+bool GNSSParser::Parse(
+	const char*	inParams)
+{
+	bool	fixParsed = false;
+	Reset();
+	do
+	{
+		fixParsed = Parse(*inParams);
+	} while (*(inParams++));
+	return(fixParsed);
+}
+
+/*********************************** Parse ************************************/
+/*
+*	Consumes one character.  A comma ends the current field, a newline or nul
+*	ends the response.
+*	Returns true when the end of the response is reached and it contained a
+*	valid fix.
+*/
+bool GNSSParser::Parse(
+	char	inChar)
+{
+	bool	fixParsed = false;
+	switch (inChar)
+	{
+		case ',':
+			EndField();
+			break;
+		case 0:
+		case '\n':
+			EndField();
+			fixParsed = EndSentence();
+			break;
+		case '-':
+			mNegative = true;
+			break;
+		case '.':
+			mInFraction = true;
+			break;
+		default:
+			if (inChar >= '0' && inChar <= '9')
+			{
+				uint8_t	digit = inChar - '0';
+				if (mField == eDateTimeField)
+				{
+					/*
+					*	yyyyMMddhhmmss.sss is copied to mDateTimeStr as
+					*	YY/MM/DD,hh:mm:ss for UnixTime::StringToUnixTime.
+					*/
+					if (!mInFraction &&
+						mDigits >= 2 &&
+						mDigits < 14)
+					{
+						uint8_t	offset = mDigits - 2;
+						mDateTimeStr[offset + offset/2] = inChar;
+					}
+				} else if (!mInFraction)
+				{
+					mValue = (mValue * 10) + digit;
+				/*
+				*	Only the coordinates need the fraction.
+				*/
+				} else if ((mField == eLatitudeField ||
+							mField == eLongitudeField) &&
+							mDecimals < kCoordinateDecimals)
+				{
+					mValue = (mValue * 10) + digit;
+					mDecimals++;
+				}
+				mDigits++;
+			}
+			break;
+	}
+	return(fixParsed);
+}
+
+/********************************** EndField **********************************/
+void GNSSParser::EndField(void)
+{
+	int32_t	value = mNegative ? -mValue : mValue;
+	switch (mField)
+	{
+		case eRunStatusField:
+			mRunStatus = value == 1;
+			break;
+		case eFixStatusField:
+			mFixStatus = value == 1;
+			break;
+		case eDateTimeField:
+			if (mDigits >= 14)
+			{
+				mWork.time = UnixTime::StringToUnixTime(mDateTimeStr, false);
+			}
+			break;
+		case eLatitudeField:
+		case eLongitudeField:
+			for (uint8_t i = mDecimals; i < kCoordinateDecimals; i++)
+			{
+				value *= 10;
+			}
+			if (mField == eLatitudeField)
+			{
+				mWork.latitude = value;
+			} else
+			{
+				mWork.longitude = value;
+			}
+			break;
+		case eAltitudeField:
+			mWork.altitude = value;
+			break;
+		case eSpeedField:
+			mWork.speed = value;
+			break;
+		case eSatsUsedField:
+			mWork.satellites = value;
+			break;
+	}
+	mField++;
+	mValue = 0;
+	mDigits = 0;
+	mDecimals = 0;
+	mNegative = false;
+	mInFraction = false;
+}
+
+/******************************** EndSentence *********************************/
+bool GNSSParser::EndSentence(void)
+{
+	bool	fixParsed = mRunStatus && mFixStatus && mField > eLongitudeField;
+	mIsRunning = mRunStatus;
+	if (fixParsed)
+	{
+		mFix = mWork;
+		mHasFix = true;
+	}
+	mField = eRunStatusField;
+	return(fixParsed);
+}
+
+/***************************** CreatePositionStr ******************************/
+/*
+*	Creates a string of the form 42.123456,-71.123456
+*	Returns a pointer to the nul terminator.
+*/
+char* GNSSParser::CreatePositionStr(
+	char*	outStr) const
+{
+	outStr = CoordinateToStr(mFix.latitude, outStr);
+	*(outStr++) = ',';
+	return(CoordinateToStr(mFix.longitude, outStr));
+}
+
+/****************************** CoordinateToStr *******************************/
+/*
+*	inCoordinate is in millionths of a degree.
+*	Returns a pointer to the nul terminator.
+*/
+char* GNSSParser::CoordinateToStr(
+	int32_t	inCoordinate,
+	char*	outStr)
+{
+	if (inCoordinate < 0)
+	{
+		*(outStr++) = '-';
+		inCoordinate = -inCoordinate;
+	}
+	char	digits[11];
+	uint8_t	numDigits = 0;
+	do
+	{
+		digits[numDigits++] = (inCoordinate % 10) + '0';
+		inCoordinate /= 10;
+	} while (inCoordinate || numDigits <= kCoordinateDecimals);
+	while (numDigits)
+	{
+		if (numDigits == kCoordinateDecimals)
+		{
+			*(outStr++) = '.';
+		}
+		*(outStr++) = digits[--numDigits];
+	}
+	*outStr = 0;
+	return(outStr);
+}
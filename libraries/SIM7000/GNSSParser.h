@@ -0,0 +1,102 @@
+/*
+*	GNSSParser.h
+*	Copyright (c) 2022 Jonathan Mackey
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*/
+#ifndef GNSSParser_H
+#define GNSSParser_H
+
+#include <inttypes.h>
+#include "UnixTime.h"
+
+struct SGNSSFix
+{
+	time32_t	time;		// UTC, 0 if unknown
+	int32_t		latitude;	// Millionths of a degree
+	int32_t		longitude;	// Millionths of a degree
+	int16_t		altitude;	// Meters above MSL
+	uint16_t	speed;		// km/h
+	uint8_t		satellites;	// GNSS satellites used
+};
+
+/*
+*	Parses the parameters of a +CGNSINF response field by field, one
+*	character at a time.  Nothing other than the current field's value is
+*	accumulated.  A fix is only copied to the last fix when both the GNSS run
+*	status and fix status fields are 1.
+*/
+class GNSSParser
+{
+public:
+							GNSSParser(void);
+	void					Reset(void);
+	bool					Parse(
+								char					inChar);
+	bool					Parse(
+								const char*				inParams);
+	bool					HasFix(void) const
+								{return(mHasFix);}
+	bool					IsRunning(void) const
+								{return(mIsRunning);}
+	const SGNSSFix&			Fix(void) const
+								{return(mFix);}
+	char*					CreatePositionStr(
+								char*					outStr) const;
+	static char*			CoordinateToStr(
+								int32_t					inCoordinate,
+								char*					outStr);
+protected:
+	SGNSSFix	mFix;		// Last valid fix
+	SGNSSFix	mWork;		// Fix being parsed
+	int32_t		mValue;
+	uint8_t		mField;
+	uint8_t		mDigits;	// Digits in this field
+	uint8_t		mDecimals;	// Digits following the decimal point
+	bool		mNegative;
+	bool		mInFraction;
+	bool		mRunStatus;
+	bool		mFixStatus;
+	bool		mIsRunning;
+	bool		mHasFix;
+	char		mDateTimeStr[18];	// YY/MM/DD,hh:mm:ss
+
+	enum EField
+	{
+		eRunStatusField,
+		eFixStatusField,
+		eDateTimeField,
+		eLatitudeField,
+		eLongitudeField,
+		eAltitudeField,
+		eSpeedField,
+		eCourseField,
+		eFixModeField,
+		eReserved1Field,
+		eHDOPField,
+		ePDOPField,
+		eVDOPField,
+		eReserved2Field,
+		eSatsInViewField,
+		eSatsUsedField
+	};
+	void					EndField(void);
+	bool					EndSentence(void);
+};
+
+#endif
@@ -43,10 +43,22 @@ set the baud rate should be sent to the SIM7000.  This reduces the startup time.
 //const uint32_t	SIM7000::kBaudRate = 19200;
 const uint32_t	SIM7000::kBaudRate = 9600;
 const uint8_t	kAutobaudEchoRetries = 10;
+/*
+*	The signal is considered favorable for sending when the smoothed rssi is at
+*	least "OK" (10 = -93 dBm) and not trending down by more than
+*	kRSSITrendThreshold.  Both are 1/16 fixed-point.
+*/
+const int16_t	kFavorableRSSI = 10*16;
+const int16_t	kRSSITrendThreshold = 4;
+const uint8_t	kMaxSignalStableShift = 2;	// Levels period up to 4x when stable
+const uint32_t	kMinCheckLevelsPeriod = 5000;
+const uint16_t	kSMSTimeout = 60000;	// CMGS max response time as per doc
+// The hash values are modulo 0x1FFF so 0xFFFF can never be a valid hash.
+const uint16_t	kDeletedURCHash = 0xFFFF;
 
 // The -1 below allows for the last byte to always be a nul.
 const uint16_t	SIM7000::kRxBufferSize = SIM7000_RX_BUFFER_SIZE-1;
-const uint16_t	SIM7000::kTxBufferSize = SIM7000_RX_BUFFER_SIZE-1;
+const uint16_t	SIM7000::kTxBufferSize = SIM7000_TX_BUFFER_SIZE-1;
 
 #define USE_PDU_SMS_FORMAT	1
 
@@ -123,9 +135,23 @@ SIM7000::SIM7000(
 		mPassthrough(nullptr), mCommandState(eReady),
 		mBars(0), mPendingMessagesHead(0), mPendingMessagesTail(0),
 		mWaitingToProcessMessage(0), mWaitingToDeleteMessage(0),
-		mDeleteMessagesAfterRead(true), mTimeIsValid(false)
+		mDeleteMessagesAfterRead(true), mTimeIsValid(false),
+		mRSSISamples(0), mSignalStableCount(0), mCheckLevelsBasePeriod(0),
+		mSMSStartTime(0), mSMSPromptTime(0), mSMSResultTime(0),
+		mSMSAcceptTimeTotal(0), mSMSSentCount(0), mSMSFailedCount(0)
+
+{
+	memset(mURCTable, 0, sizeof(mURCTable));
+	ResetRxStats();
+}
 
+/******************************** ResetRxStats ********************************/
+void SIM7000::ResetRxStats(void)
 {
+	mRxBytes = 0;
+	mRxLines = 0;
+	mRxPeakLength = 0;
+	mRxOverruns = 0;
 }
 
 /******************************* FlushRxBuffer ********************************/
@@ -188,6 +214,8 @@ void SIM7000::Sleep(void)
 		mPinPeriod.Start();				// as per doc
 		mSleepState = eGoingToSleep;
 		mCheckLevelsPeriod.Set(0);
+		mCheckLevelsBasePeriod = 0;
+		mRSSISamples = 0;
 		mBars = 0;
 		mBatteryLevel = 0;
 	}
@@ -285,6 +313,7 @@ void SIM7000::Update(void)
 	while (mSerial.available())
 	{
 		uint8_t	byteRead = mSerial.read();
+		mRxBytes++;
 		switch (byteRead)
 		{
 			case '\r':	// Ignore carriage returns
@@ -301,6 +330,7 @@ void SIM7000::Update(void)
 				*/
 				if (mRxBufferPtr > mRxBuffer)
 				{
+					mRxLines++;
 					*mRxBufferPtr = 0;	// Mark the end of the response string
 					mRxBufferPtr = mRxBuffer;	// Rewind the response buffer
 					HandleCommandResponse();
@@ -313,10 +343,19 @@ void SIM7000::Update(void)
 					mPassthrough->write(byteRead);
 				}
 				{
-					uint8_t	rxLen = mRxBufferPtr - mRxBuffer;
+					/*
+					*	Note that rxLen must be able to hold kRxBufferSize.
+					*	(when it was a uint8_t the overrun test below could
+					*	never fail for a 512 byte buffer.)
+					*/
+					uint16_t	rxLen = mRxBufferPtr - mRxBuffer;
 					if (rxLen < kRxBufferSize)
 					{
 						rxLen++;
+						if (rxLen > mRxPeakLength)
+						{
+							mRxPeakLength = rxLen;
+						}
 						*(mRxBufferPtr++) = byteRead;
 						*mRxBufferPtr = 0;	// Always terminate for debugging
 						if (mSMSStatus == eSMSSending &&
@@ -330,6 +369,7 @@ void SIM7000::Update(void)
 						// This is a punt, because something is very wrong.
 						// The rx buffer is already terminated in begin()
 						mRxBufferPtr = mRxBuffer;	  // Rewind
+						mRxOverruns++;
 						if (mPassthrough)
 						{
 							mPassthrough->print(F("\n>>> Buffer overrun\n"));
@@ -555,6 +595,7 @@ void SIM7000::ParseCommandResponse(void)
 						{
 							mBars = 40 + (((rssi - 20)*10)/11);	// Excellent
 						}
+						UpdateSignalAverage(rssi);
 					} else
 					{
 						mBars = 99;
@@ -631,9 +672,10 @@ void SIM7000::ParseCommandResponse(void)
 				{
 					mCommandState = eError;
 					mCommandTimeout.Set(0);
-					if (mSMSStatus == eSMSWaiting)
+					if (mSMSStatus == eSMSSending ||
+						mSMSStatus == eSMSWaiting)
 					{
-						mSMSStatus = eSMSFailed;
+						SetSMSStatus(eSMSFailed);
 					}
 					break;
 				}
@@ -704,7 +746,7 @@ void SIM7000::ParseCommandResponse(void)
 				{
 					if (mSMSStatus == eSMSWaiting)
 					{
-						mSMSStatus = eSMSSent;
+						SetSMSStatus(eSMSSent);
 					}
 					break;
 				}
@@ -717,6 +759,13 @@ void SIM7000::ParseCommandResponse(void)
 					}
 					break;
 				}
+				/*
+				*	Anything not handled above is passed to the handler
+				*	registered for the command hash, if any.
+				*/
+				default:
+					DispatchURC(hash, rxBufferPtr);
+					break;
 			}
 		}
 		break;
@@ -836,6 +885,11 @@ void SIM7000::HandleCommandTimeout(void)
 	mCommandHash = 0;
 	mCommandState = eTimeout;
 	mCommandTimeout.Set(0);	// Disable timeout timer (Passed will return false)
+	if (mSMSStatus == eSMSSending ||
+		mSMSStatus == eSMSWaiting)
+	{
+		SetSMSStatus(eSMSFailed);
+	}
 	if (mSleepState != eWakingUp)
 	{
 		switch (commandHash)
@@ -880,6 +934,11 @@ void SIM7000::HandleCommandFailed(void)
 	//uint16_t	commandHash = mCommandHash;
 	mCommandHash = 0;
 	mCommandState = eError;
+	if (mSMSStatus == eSMSSending ||
+		mSMSStatus == eSMSWaiting)
+	{
+		SetSMSStatus(eSMSFailed);
+	}
 	//if (mSleepState != eWakingUp)
 	//{
 	//	switch (commandHash)
@@ -888,6 +947,142 @@ void SIM7000::HandleCommandFailed(void)
 	//}
 }
 
+/******************************** CommandHash *********************************/
+/*
+*	Returns the hash of the PROGMEM string inPrefix using the same equation
+*	used by ParseCommandResponse (see SIM7000ATCmdHash.h)  inPrefix should not
+*	include the leading '+' or the trailing colon, e.g. F("CGNSINF")
+*/
+uint16_t SIM7000::CommandHash(
+	const __FlashStringHelper*	inPrefix)
+{
+	const char*	prefixPtr = (const char*)inPrefix;
+	uint16_t	hash = 0;
+	for (char thisChar = pgm_read_byte(prefixPtr); thisChar;
+			thisChar = pgm_read_byte(++prefixPtr))
+	{
+		hash = ((uint16_t)((hash + thisChar) * thisChar)) % 0x1FFF;
+	}
+	return(hash);
+}
+
+/***************************** RegisterURCHandler *****************************/
+/*
+*	Registers inHandler to be called for any +cccc: response where the hash of
+*	cccc is inCommandHash, and the response isn't already handled by
+*	ParseCommandResponse.  The handler table is a small open addressing hash
+*	table (linear probe) so dispatch is a single lookup in the common case.
+*	Registering an existing hash replaces the handler.
+*	Returns false if the table is full or inCommandHash is one of the values
+*	reserved to mark empty and deleted entries.
+*/
+bool SIM7000::RegisterURCHandler(
+	uint16_t	inCommandHash,
+	URCHandler	inHandler)
+{
+	SURCEntry*	entry = nullptr;
+	if (inCommandHash == 0 ||
+		inCommandHash == kDeletedURCHash)
+	{
+		return(false);
+	}
+	uint8_t		index = inCommandHash & (SIM7000_URC_TABLE_SIZE-1);
+	for (uint8_t i = 0; i < SIM7000_URC_TABLE_SIZE; i++)
+	{
+		SURCEntry*	thisEntry = &mURCTable[index];
+		if (thisEntry->hash == inCommandHash)
+		{
+			entry = thisEntry;
+			break;
+		}
+		if (thisEntry->hash == 0 ||
+			thisEntry->hash == kDeletedURCHash)
+		{
+			if (!entry)
+			{
+				entry = thisEntry;
+			}
+			/*
+			*	An empty entry ends the probe sequence.  A deleted entry can be
+			*	reused but the probe continues in case the hash is already
+			*	registered further along.
+			*/
+			if (thisEntry->hash == 0)
+			{
+				break;
+			}
+		}
+		index = (index + 1) & (SIM7000_URC_TABLE_SIZE-1);
+	}
+	if (entry)
+	{
+		entry->hash = inCommandHash;
+		entry->handler = inHandler;
+	}
+	return(entry != nullptr);
+}
+
+/***************************** RegisterURCHandler *****************************/
+bool SIM7000::RegisterURCHandler(
+	const __FlashStringHelper*	inPrefix,
+	URCHandler					inHandler)
+{
+	return(RegisterURCHandler(CommandHash(inPrefix), inHandler));
+}
+
+/**************************** UnregisterURCHandler ****************************/
+void SIM7000::UnregisterURCHandler(
+	uint16_t	inCommandHash)
+{
+	uint8_t		index = inCommandHash & (SIM7000_URC_TABLE_SIZE-1);
+	for (uint8_t i = 0; i < SIM7000_URC_TABLE_SIZE; i++)
+	{
+		SURCEntry*	entry = &mURCTable[index];
+		if (entry->hash == inCommandHash)
+		{
+			entry->hash = kDeletedURCHash;
+			break;
+		}
+		if (entry->hash == 0)
+		{
+			break;
+		}
+		index = (index + 1) & (SIM7000_URC_TABLE_SIZE-1);
+	}
+}
+
+/******************************** DispatchURC *********************************/
+/*
+*	Returns true if a handler was registered for inCommandHash.  The reserved
+*	empty and deleted hash values never match an entry.
+*/
+bool SIM7000::DispatchURC(
+	uint16_t	inCommandHash,
+	const char*	inParams)
+{
+	if (inCommandHash == 0 ||
+		inCommandHash == kDeletedURCHash)
+	{
+		return(false);
+	}
+	uint8_t		index = inCommandHash & (SIM7000_URC_TABLE_SIZE-1);
+	for (uint8_t i = 0; i < SIM7000_URC_TABLE_SIZE; i++)
+	{
+		SURCEntry*	entry = &mURCTable[index];
+		if (entry->hash == inCommandHash)
+		{
+			(this->*entry->handler)(inParams);
+			return(true);
+		}
+		if (entry->hash == 0)
+		{
+			break;
+		}
+		index = (index + 1) & (SIM7000_URC_TABLE_SIZE-1);
+	}
+	return(false);
+}
+
 /************************* ParseOtherCommandResponse **************************/
 void SIM7000::ParseOtherCommandResponse(void)
 {
@@ -901,9 +1096,93 @@ void SIM7000::ParseOtherCommandResponse(void)
 void SIM7000::SetCheckLevelsPeriod(
 	uint32_t	inPeriod)
 {
+	mCheckLevelsBasePeriod = inPeriod;
+	mSignalStableCount = 0;
 	mCheckLevelsPeriod.Set(inPeriod);
 }
 
+/**************************** UpdateSignalAverage *****************************/
+/*
+*	Called for each +CSQ rssi sample.  mRSSIAvg is an EWMA of the rssi and
+*	mRSSITrend is an EWMA of the change in mRSSIAvg (alpha = 1/4 for both.)
+*
+*	The levels check period is adapted to the signal: each stable sample
+*	doubles the period up to 4x the period set by SetCheckLevelsPeriod.  When
+*	the signal is degrading or marginal the period is halved so that a better
+*	send window is noticed sooner.
+*/
+void SIM7000::UpdateSignalAverage(
+	uint16_t	inRSSI)
+{
+	int16_t	sample = inRSSI == 99 ? 0 : inRSSI*16;	// 99 = not detectable
+	if (mRSSISamples)
+	{
+		int16_t	prevAvg = mRSSIAvg;
+		mRSSIAvg += (sample - mRSSIAvg)/4;
+		mRSSITrend += ((mRSSIAvg - prevAvg) - mRSSITrend)/4;
+	} else
+	{
+		mRSSIAvg = sample;
+		mRSSITrend = 0;
+	}
+	if (mRSSISamples < 0xFF)
+	{
+		mRSSISamples++;
+	}
+	if (mCheckLevelsBasePeriod)
+	{
+		uint32_t	period = mCheckLevelsBasePeriod;
+		if (mRSSITrend <= -kRSSITrendThreshold ||
+			mRSSIAvg < kFavorableRSSI)
+		{
+			mSignalStableCount = 0;
+			period /= 2;
+			if (period < kMinCheckLevelsPeriod)
+			{
+				period = kMinCheckLevelsPeriod;
+			}
+		} else if (mRSSITrend < kRSSITrendThreshold)
+		{
+			if (mSignalStableCount < kMaxSignalStableShift)
+			{
+				mSignalStableCount++;
+			}
+			period <<= mSignalStableCount;
+		} else
+		{
+			mSignalStableCount = 0;	// Improving, stay at the base period
+		}
+		mCheckLevelsPeriod.Set(period);
+	}
+}
+
+/***************************** SignalIsFavorable ******************************/
+bool SIM7000::SignalIsFavorable(void) const
+{
+	return(mRSSISamples &&
+		mRSSIAvg >= kFavorableRSSI &&
+		mRSSITrend > -kRSSITrendThreshold);
+}
+
+/******************************** SetSMSStatus ********************************/
+/*
+*	Bottleneck for the final SMS status so the send statistics are kept.
+*/
+void SIM7000::SetSMSStatus(
+	uint8_t	inSMSStatus)
+{
+	mSMSStatus = inSMSStatus;
+	mSMSResultTime = millis();
+	if (inSMSStatus == eSMSSent)
+	{
+		mSMSSentCount++;
+		mSMSAcceptTimeTotal += (mSMSResultTime - mSMSStartTime);
+	} else if (inSMSStatus == eSMSFailed)
+	{
+		mSMSFailedCount++;
+	}
+}
+
 /******************************** CheckLevels *********************************/
 /*
 *	Initiates a check levels set of commands.
@@ -922,6 +1201,28 @@ void SIM7000::CheckLevels(void)
 	}
 }
 
+/******************************** SetGNSSPower ********************************/
+/*
+*	Turns the GNSS engine on or off.  Like all commands, this fails if a
+*	command is already in progress.
+*/
+bool SIM7000::SetGNSSPower(
+	bool	inOn)
+{
+	return(SendCommand(inOn ? F("AT+CGNSPWR=1") : F("AT+CGNSPWR=0"),
+															kCGNSPWRCmdHash));
+}
+
+/****************************** RequestGNSSInfo *******************************/
+/*
+*	Requests the current GNSS navigation information.  The +CGNSINF response
+*	is passed to the URC handler registered for kCGNSINFCmdHash, if any.
+*/
+bool SIM7000::RequestGNSSInfo(void)
+{
+	return(SendCommand(F("AT+CGNSINF"), 0, 2000));
+}
+
 /****************************** TurnOffEchoMode *******************************/
 void SIM7000::TurnOffEchoMode(
 	uint8_t	inRetries)
@@ -930,16 +1231,27 @@ void SIM7000::TurnOffEchoMode(
 	SendCommand(F("ATE0"), kATE0CmdHash);
 }
 
-//const uint8_t	kPDUSubmitPreambleSize = 28;	// If not sending SMSC params
-const uint8_t	kPDUSubmitPreambleSize = 30;	// If sending SMSC params
+// Hex characters of the TPDU other than the phone number and user data:
+// SMSC, first octet, message ref, number length, number type, PID, DCS,
+// validity period and user data length.
+const uint8_t	kPDUSubmitPreambleSize = 18;
 /********************************** SendSMS ***********************************/
+/*
+*	Only single SMS messages are supported.  Every character of the message is
+*	assumed to be a single GSM 7-bit septet (see TPDU::Pack7BitToPDU.)
+*/
 bool SIM7000::SendSMS(
 	const char*	inPhoneNumber,
 	const char*	inMessage)
 {
+	uint16_t	messageLen = strlen(inMessage);
 #ifdef USE_PDU_SMS_FORMAT
+	uint16_t	pduLen = kPDUSubmitPreambleSize +
+							((strlen(inPhoneNumber) + 1) & 0xFFFE) +
+							(((messageLen * 7) + 7) / 8) * 2;
 	bool sent = ClearToSendSMS() &&
-		strlen(inMessage) < ((kTxBufferSize-kPDUSubmitPreambleSize)*8)/7;
+		messageLen <= kMaxSMSLength &&
+		pduLen <= kTxBufferSize;
 	if (sent)
 	{
 		FlushRxBuffer();
@@ -948,9 +1260,12 @@ bool SIM7000::SendSMS(
 		mSerial.println();
 		
 		mSMSStatus = eSMSSending;
+		StartSMSCommand();
 	}
 #else
-	bool sent = ClearToSendSMS() && strlen(inMessage) < kTxBufferSize;
+	bool sent = ClearToSendSMS() &&
+		messageLen <= kMaxSMSLength &&
+		messageLen <= kTxBufferSize;
 	if (sent)
 	{
 		FlushRxBuffer();
@@ -960,11 +1275,26 @@ bool SIM7000::SendSMS(
 		
 		strcpy(mTxBuffer, inMessage);
 		mSMSStatus = eSMSSending;
+		StartSMSCommand();
 	}
 #endif
 	return(sent);
 }
 
+/****************************** StartSMSCommand *******************************/
+/*
+*	The send is treated as a command so that nothing else is sent to the SIM7000
+*	till the send completes, fails, or times out.
+*/
+void SIM7000::StartSMSCommand(void)
+{
+	mCommandHash = kCMGSCmdHash;
+	mCommandState = eBusy;
+	mCommandTimeout.Set(kSMSTimeout);
+	mCommandTimeout.Start();
+	mSMSStartTime = millis();
+}
+
 /******************************* SendSMSMessage *******************************/
 /*
 *	This is called from Update when "> " is received from the SIM7000 when the
@@ -978,6 +1308,7 @@ void SIM7000::SendSMSMessage(void)
 	if (mSMSStatus == eSMSSending)
 	{
 		mSMSStatus = eSMSWaiting;
+		mSMSPromptTime = millis();
 		FlushRxBuffer();
 		mSerial.print(mTxBuffer);
 		mSerial.print('\x1A');
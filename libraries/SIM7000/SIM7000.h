@@ -27,7 +27,8 @@
 #include "TPDU.h"
 
 #define SIM7000_RX_BUFFER_SIZE	512
-#define SIM7000_TX_BUFFER_SIZE	300	// Should be set to the largest Tx TPDU length
+#define SIM7000_TX_BUFFER_SIZE	320	// Largest Tx TPDU, 160 septets to a 15 digit number
+#define SIM7000_URC_TABLE_SIZE	8	// Must be a power of 2
 
 class SIM7000 : public TPDU
 {
@@ -54,6 +55,12 @@ public:
 		eSMSSent,
 		eSMSFailed
 	};
+	/*
+	*	URC handlers are passed a pointer to the first non-whitespace character
+	*	following the colon delimiter of a +cccc: response.
+	*/
+	typedef void (SIM7000::*URCHandler)(
+								const char*				inParams);
 							SIM7000(
 								HardwareSerial&			inSerial,
 								uint8_t					inRxPin,
@@ -92,9 +99,14 @@ public:
 	void					CheckLevels(void);
 	void					SetCheckLevelsPeriod(
 								uint32_t				inPeriod = 0);
+	bool					SetGNSSPower(
+								bool					inOn);
+	bool					RequestGNSSInfo(void);
+							// Fails if inMessage is over kMaxSMSLength septets
 	bool					SendSMS(
 								const char*				inPhoneNumber,
 								const char*				inMessage);
+	static const uint8_t	kMaxSMSLength = 160;	// Septets, single SMS
 	uint8_t					SMSStatus(void) const
 								{return(mSMSStatus);}
 	void					ResetSMSStatus(void)
@@ -103,6 +115,27 @@ public:
 							// If this is not done then no SMS texts can be sent.
 	bool					ClearToSendSMS(void) const
 								{return(ConnectedAndClearToSend() && mSMSStatus == eSMSIdle);}
+							// Smoothed RSSI and its trend, both fixed-point 1/16
+	int16_t					SmoothedRSSI(void) const
+								{return(mRSSIAvg);}
+	int16_t					RSSITrend(void) const
+								{return(mRSSITrend);}
+	bool					SignalIsFavorable(void) const;
+							// SMS send statistics
+	uint16_t				SMSSentCount(void) const
+								{return(mSMSSentCount);}
+	uint16_t				SMSFailedCount(void) const
+								{return(mSMSFailedCount);}
+	uint32_t				MeanSMSAcceptTime(void) const
+								{return(mSMSSentCount ? mSMSAcceptTimeTotal/mSMSSentCount : 0);}
+							// Trace points of the last SMS send (millis):
+							// AT+CMGS sent, '>' prompt, final status
+	uint32_t				SMSStartTime(void) const
+								{return(mSMSStartTime);}
+	uint32_t				SMSPromptTime(void) const
+								{return(mSMSPromptTime);}
+	uint32_t				SMSResultTime(void) const
+								{return(mSMSResultTime);}
 	void					TurnOffEchoMode(
 								uint8_t					inRetries = 0);
 	bool					SendCommand(
@@ -122,11 +155,36 @@ public:
 								{mDeleteMessagesAfterRead = inDeleteMessagesAfterRead;}
 								
 //	void					DumpRxBuffer(void) const;
+	bool					RegisterURCHandler(
+								uint16_t				inCommandHash,
+								URCHandler				inHandler);
+	bool					RegisterURCHandler(
+								const __FlashStringHelper*	inPrefix,
+								URCHandler				inHandler);
+	void					UnregisterURCHandler(
+								uint16_t				inCommandHash);
+	static uint16_t			CommandHash(
+								const __FlashStringHelper*	inPrefix);
+							// Rx parse statistics, see Update()
+	uint32_t				RxBytes(void) const
+								{return(mRxBytes);}
+	uint32_t				RxLines(void) const
+								{return(mRxLines);}
+	uint16_t				RxPeakLength(void) const
+								{return(mRxPeakLength);}
+	uint16_t				RxOverruns(void) const
+								{return(mRxOverruns);}
+	void					ResetRxStats(void);
 	static const __FlashStringHelper * GetSleepStateStr(
 								uint8_t					inState);
 	static const __FlashStringHelper * GetCommandStateStr(
 								uint8_t					inState);
 protected:
+	struct SURCEntry
+	{
+		uint16_t	hash;	// 0 = empty, kDeletedURCHash = deleted
+		URCHandler	handler;
+	};
 	uint8_t			mRxPin;
 	uint8_t			mTxPin;
 	uint8_t			mPowerPin;
@@ -146,16 +204,32 @@ protected:
 	bool			mRxPaused;
 	bool			mDeleteMessagesAfterRead;	// Set to false to keep processed messages on SIM
 	uint8_t			mConnectionStatus;
+	uint8_t			mRSSISamples;
+	uint8_t			mSignalStableCount;
+	int16_t			mRSSIAvg;		// EWMA of the +CSQ rssi, 1/16 scale
+	int16_t			mRSSITrend;		// EWMA of the change in mRSSIAvg, 1/16 scale
+	uint32_t		mCheckLevelsBasePeriod;
+	uint32_t		mSMSStartTime;
+	uint32_t		mSMSPromptTime;
+	uint32_t		mSMSResultTime;
+	uint32_t		mSMSAcceptTimeTotal;
+	uint16_t		mSMSSentCount;
+	uint16_t		mSMSFailedCount;
 	uint16_t		mPendingCommandHash;
 	uint16_t		mCommandHash;
 	char			mTxBuffer[SIM7000_TX_BUFFER_SIZE];
 	char			mRxBuffer[SIM7000_RX_BUFFER_SIZE];
 	char*			mRxBufferPtr;
+	uint32_t		mRxBytes;
+	uint32_t		mRxLines;
+	uint16_t		mRxPeakLength;	// Longest line received
+	uint16_t		mRxOverruns;
 	HardwareSerial*	mPassthrough;
 	MSPeriod		mPinPeriod;
 	MSPeriod		mCommandTimeout;
 	MSPeriod		mCheckLevelsPeriod;
 	HardwareSerial&	mSerial;
+	SURCEntry		mURCTable[SIM7000_URC_TABLE_SIZE];
 	static const uint32_t	kBaudRate;	// Initial, after power up
 	static const uint16_t	kRxBufferSize;
 	static const uint16_t	kTxBufferSize;
@@ -173,6 +247,13 @@ protected:
 	bool					HandleMultiLineCommand(void);
 	void					ParseCommandResponse(void);
 	void					ParseOtherCommandResponse(void);
+	bool					DispatchURC(
+								uint16_t				inCommandHash,
+								const char*				inParams);
+	void					UpdateSignalAverage(
+								uint16_t				inRSSI);
+	void					SetSMSStatus(
+								uint8_t					inSMSStatus);
 	void					UpdateTime(
 								uint32_t				inTime);
 	void					HandleCommandFailed(void);
@@ -180,6 +261,7 @@ protected:
 	void					PauseRx(void);
 	void					ResumeRx(void);
 	void					SendSMSMessage(void);
+	void					StartSMSCommand(void);
 };
 
 #endif
\ No newline at end of file
@@ -64,6 +64,8 @@ const uint16_t kCGDCONTCmdHash		= 1998;	// +CGDCONT
 const uint16_t kCGMICmdHash			= 4522;	// +CGMI
 const uint16_t kCGMMCmdHash			= 3278;	// +CGMM
 const uint16_t kCGMRCmdHash			= 1778;	// +CGMR
+const uint16_t kCGNSINFCmdHash		= 4490;	// +CGNSINF
+const uint16_t kCGNSPWRCmdHash		= 7033;	// +CGNSPWR
 const uint16_t kCGPADDRCmdHash		= 4309;	// +CGPADDR
 const uint16_t kCGPIOCmdHash		= 2529;	// +CGPIO
 const uint16_t kCGREGCmdHash		= 6103;	// +CGREG
@@ -0,0 +1,73 @@
+/*
+*	ScheduledSensor.h, Copyright (c) 2022 Jonathan Mackey
+*	Interface of a sensor serviced by SensorScheduler.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef ScheduledSensor_h
+#define ScheduledSensor_h
+
+#include <inttypes.h>
+
+/*
+*	A sensor has one or more channels, each a fixed-point reading.  Run() is
+*	called by SensorScheduler when the sensor is due.  Each call should
+*	perform at most one step of the sensor's work (e.g. starting or reading a
+*	conversion) so that the steps of different sensors don't pile up in one
+*	loop iteration.  For a single device a step is generally one bus
+*	transaction.  For several devices on a bus a step may address each in
+*	turn, so its time grows with the device count.
+*/
+class ScheduledSensor
+{
+public:
+	enum EChannelType
+	{
+		eTemperature,	// 1/16 C
+		eHumidity,		// 1/16 %RH
+		eOtherChannel
+	};
+							ScheduledSensor(void)
+								: mNewReading(false){}
+	/*
+	*	Performs the next step and returns the ms till the sensor should run
+	*	again, 0 = the next loop iteration (e.g. waiting on a conversion.)
+	*/
+	virtual uint32_t		Run(void) = 0;
+	virtual uint8_t			GetChannelCount(void) const = 0;
+	virtual uint8_t			GetChannelType(
+								uint8_t					inChannel) const = 0;
+	virtual int16_t			GetReading(
+								uint8_t					inChannel) const = 0;
+	virtual bool			ReadingIsValid(
+								uint8_t					inChannel) const
+								{return(true);}
+							// Returns true once after Run() updated the
+							// readings.
+	bool					TakeNewReading(void)
+							{
+								bool	newReading = mNewReading;
+								mNewReading = false;
+								return(newReading);
+							}
+protected:
+	bool	mNewReading;
+};
+
+#endif // ScheduledSensor_h
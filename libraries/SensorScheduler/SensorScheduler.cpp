@@ -0,0 +1,79 @@
+/*
+*	SensorScheduler.cpp, Copyright (c) 2022 Jonathan Mackey
+*	Cooperative scheduler for polled sensors.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include <Arduino.h>
+#include "SensorScheduler.h"
+
+/****************************** SensorScheduler *******************************/
+SensorScheduler::SensorScheduler(
+	uint16_t	inStagger)
+	: mMaxRunTime(0), mStagger(inStagger), mCount(0), mMaxRunSensor(kNoSensor)
+{
+}
+
+/********************************* AddSensor **********************************/
+bool SensorScheduler::AddSensor(
+	ScheduledSensor&	inSensor)
+{
+	bool	added = mCount < SENSOR_SCHEDULER_MAX_SENSORS;
+	if (added)
+	{
+		mSensor[mCount] = &inSensor;
+		mDeadline[mCount] = millis() + (uint32_t)mCount * mStagger;
+		mCount++;
+	}
+	return(added);
+}
+
+/*********************************** Update ***********************************/
+/*
+*	The deadlines are compared as signed differences so that the millis()
+*	rollover (~49 days) doesn't matter.
+*/
+uint8_t SensorScheduler::Update(void)
+{
+	uint32_t	now = millis();
+	uint8_t		due = kNoSensor;
+	int32_t		mostOverdue = -1;
+	for (uint8_t i = 0; i < mCount; i++)
+	{
+		int32_t	overdue = now - mDeadline[i];
+		if (overdue > mostOverdue)
+		{
+			mostOverdue = overdue;
+			due = i;
+		}
+	}
+	if (due != kNoSensor)
+	{
+		uint32_t	startTime = micros();
+		uint32_t	delay = mSensor[due]->Run();
+		uint32_t	runTime = micros() - startTime;
+		if (runTime > mMaxRunTime)
+		{
+			mMaxRunTime = runTime;
+			mMaxRunSensor = due;
+		}
+		mDeadline[due] = millis() + delay;
+	}
+	return(due);
+}
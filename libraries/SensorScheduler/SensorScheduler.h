@@ -0,0 +1,73 @@
+/*
+*	SensorScheduler.h, Copyright (c) 2022 Jonathan Mackey
+*	Cooperative scheduler for polled sensors.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef SensorScheduler_h
+#define SensorScheduler_h
+
+#include <inttypes.h>
+#include "ScheduledSensor.h"
+
+#define SENSOR_SCHEDULER_MAX_SENSORS	4
+
+/*
+*	Each sensor has a deadline, the millis() time it's next due.  Update()
+*	runs at most one sensor per call, the most overdue, so bus transactions
+*	of different sensors never pile up in one loop iteration.  The worst case
+*	time of Update() is that of the slowest single sensor step rather than the
+*	sum of all of them.  The first deadlines are staggered by inStagger ms so
+*	that sensors with the same period don't all come due together.
+*/
+class SensorScheduler
+{
+public:
+							SensorScheduler(
+								uint16_t				inStagger = 250);
+							// Returns false if there are already
+							// SENSOR_SCHEDULER_MAX_SENSORS sensors.
+	bool					AddSensor(
+								ScheduledSensor&		inSensor);
+	uint8_t					GetSensorCount(void) const
+								{return(mCount);}
+	ScheduledSensor*		GetSensor(
+								uint8_t					inIndex) const
+								{return(mSensor[inIndex]);}
+							// Returns the index of the sensor run, or
+							// kNoSensor if none were due.
+	uint8_t					Update(void);
+							// Longest Run() in us
+	uint32_t				MaxRunTime(void) const
+								{return(mMaxRunTime);}
+	uint8_t					MaxRunSensor(void) const
+								{return(mMaxRunSensor);}
+	void					ResetMaxRunTime(void)
+								{mMaxRunTime = 0;}
+	static const uint8_t	kNoSensor = 0xFF;
+protected:
+	ScheduledSensor*	mSensor[SENSOR_SCHEDULER_MAX_SENSORS];
+	uint32_t	mDeadline[SENSOR_SCHEDULER_MAX_SENSORS];
+	uint32_t	mMaxRunTime;
+	uint16_t	mStagger;
+	uint8_t		mCount;
+	uint8_t		mMaxRunSensor;
+};
+
+#endif // SensorScheduler_h
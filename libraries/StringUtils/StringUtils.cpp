@@ -30,9 +30,16 @@
 #define pgm_read_byte(xx) *(xx)
 #define pgm_read_word(xx) *(xx)
 #define strcmp_P strcmp
+#define PROGMEM
 #endif
 
 const char StringUtils::kHexChars[] = "0123456789ABCDEF";
+/*
+*	Tenths digit of each 1/16 fraction, always rounded up, even for negative
+*	numbers, i.e. (((n*625)+500) / 1000)
+*/
+static const char kSixteenthsToTenths[] PROGMEM = "0112334456678899";
+static const uint16_t kPowersOf10[] PROGMEM = {1000, 100, 10};
 
 /**************************** SkipWhitespaceOnLine ****************************/
 /*
@@ -236,32 +243,39 @@ void StringUtils::Uint16ToDecStr(
 *	Returns the number of characters before the decimal point.  This is used for
 *	text that you want to center on the decimal point so it doesn't jump around.
 *	This is most commonly noticeable for celsius around 0C
+*
+*	The AVR has no divide instruction so the integer part (0 to 2048) is
+*	converted by repeated subtraction, and the fraction by table lookup.
 */
 uint8_t StringUtils::Fixed16ToDec10Str(
 	int16_t	inNum,
 	char*	inBuffer)
 {
-	uint8_t	charsBeforeDec = 0;
+	char*	bufPtr = inBuffer;
+	uint16_t	num = inNum;
 	if (inNum < 0)
 	{
-		*(inBuffer++) = '-';
-		inNum = -inNum;
-		charsBeforeDec++;
+		*(bufPtr++) = '-';
+		num = -num;
 	}
-	int32_t	decNum = inNum >> 4;
-	for (int32_t num = decNum; num/=10; inBuffer++);
-	char*	bufPtr = inBuffer;
-	do
+	uint16_t	wholeNum = num >> 4;
+	bool	leadingZero = true;
+	for (uint8_t i = 0; i < 3; i++)
 	{
-		*(bufPtr--) = (decNum % 10) + '0';
-		decNum /= 10;
-	} while (decNum);
-	charsBeforeDec += (inBuffer - bufPtr);
-	inBuffer[1] = '.';
-	// Always round up, even for negative numbers.
-	// Convert 1/16 fixed-point fraction to 1/1000, round up, then convert to 1/1
-	inBuffer[2] = ((((inNum & 0xF)*625)+500) / 1000) + '0';
-	inBuffer[3] = 0;
+		uint16_t	power = pgm_read_word(&kPowersOf10[i]);
+		char	digit = '0';
+		for (; wholeNum >= power; wholeNum -= power, digit++);
+		if (digit != '0' || !leadingZero)
+		{
+			*(bufPtr++) = digit;
+			leadingZero = false;
+		}
+	}
+	*(bufPtr++) = wholeNum + '0';
+	uint8_t	charsBeforeDec = bufPtr - inBuffer;
+	bufPtr[0] = '.';
+	bufPtr[1] = pgm_read_byte(&kSixteenthsToTenths[num & 0xF]);
+	bufPtr[2] = 0;
 	return(charsBeforeDec);
 }
 
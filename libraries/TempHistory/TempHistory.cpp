@@ -0,0 +1,255 @@
+/*
+*	TempHistory.cpp, Copyright (c) 2022 Jonathan Mackey
+*	Compact per sensor temperature history.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#include "TempHistory.h"
+#include <Arduino.h>
+
+/******************************** TempHistory *********************************/
+TempHistory::TempHistory(
+	uint32_t			inWindowPeriod,
+	uint8_t				inCapacity,
+	uint8_t				inBlocksPerSensor,
+	uint8_t*			inBlocks,
+	STempHistoryRing*	inRings)
+	: mWindowPeriod(inWindowPeriod), mBlocks(inBlocks), mRings(inRings),
+	  mCapacity(inCapacity), mCount(0), mBlocksPerSensor(inBlocksPerSensor),
+	  mMaxAppendTime(0)
+{
+	// Note that the storage belongs to the subclass and isn't constructed yet.
+}
+
+/*********************************** begin ************************************/
+void TempHistory::begin(
+	uint8_t	inCount)
+{
+	mCount = inCount > mCapacity ? mCapacity : inCount;
+	memset(mRings, 0, mCapacity * sizeof(STempHistoryRing));
+	mWindowPeriod.Start();
+}
+
+/********************************* AddReading *********************************/
+void TempHistory::AddReading(
+	uint8_t	inIndex,
+	int16_t	inTemp)
+{
+	if (inIndex < mCount)
+	{
+		STempHistoryRing&	ring = mRings[inIndex];
+		if (ring.count == 0)
+		{
+			ring.min = inTemp;
+			ring.max = inTemp;
+			ring.sum = 0;
+		} else if (ring.count == 0xFF)
+		{
+			return;	// The window period is too long for the update period
+		}
+		if (inTemp < ring.min)
+		{
+			ring.min = inTemp;
+		} else if (inTemp > ring.max)
+		{
+			ring.max = inTemp;
+		}
+		ring.sum += inTemp;
+		ring.count++;
+	}
+}
+
+/*********************************** Update ***********************************/
+/*
+*	At the end of each window the rounded mean of each sensor's window is
+*	appended to its ring.
+*/
+bool TempHistory::Update(void)
+{
+	bool	windowEnded = mWindowPeriod.Passed();
+	if (windowEnded)
+	{
+		mWindowPeriod.Start();
+		for (uint8_t i = 0; i < mCount; i++)
+		{
+			STempHistoryRing&	ring = mRings[i];
+			if (ring.count)
+			{
+				int32_t	halfCount = ring.count/2;
+				int16_t	mean = (ring.sum + (ring.sum < 0 ? -halfCount : halfCount)) / ring.count;
+				ring.count = 0;
+				uint16_t	startTime = micros();
+				Append(i, mean);
+				uint16_t	appendTime = (uint16_t)micros() - startTime;
+				if (appendTime > mMaxAppendTime)
+				{
+					mMaxAppendTime = appendTime;
+				}
+			}
+		}
+	}
+	return(windowEnded);
+}
+
+/*********************************** Append ***********************************/
+/*
+*	A new block is started when the sample won't fit in the newest block.  When
+*	all of the blocks are in use the oldest block is reused.
+*/
+void TempHistory::Append(
+	uint8_t	inIndex,
+	int16_t	inTemp)
+{
+	STempHistoryRing&	ring = mRings[inIndex];
+	int16_t	delta = inTemp - ring.last;
+	uint16_t	zigzag = (uint16_t)(delta << 1) ^ (uint16_t)(delta >> 15);
+	uint8_t	nibblesNeeded = zigzag < kEscape ? 1 : 5;
+	if (ring.blocks == 0 ||
+		(ring.nibbles + nibblesNeeded) > kMaxNibbles)
+	{
+		if (ring.blocks)
+		{
+			ring.head = ring.head + 1 < mBlocksPerSensor ? ring.head + 1 : 0;
+		}
+		if (ring.blocks < mBlocksPerSensor)
+		{
+			ring.blocks++;
+		}
+		uint8_t*	block = Block(inIndex, ring.head);
+		memcpy(block, &inTemp, sizeof(int16_t));
+		block[2] = 1;
+		ring.nibbles = 0;
+	} else
+	{
+		uint8_t*	block = Block(inIndex, ring.head);
+		if (nibblesNeeded == 1)
+		{
+			WriteNibble(block, ring.nibbles++, zigzag);
+		} else
+		{
+			WriteNibble(block, ring.nibbles++, kEscape);
+			uint16_t	value = inTemp;
+			for (uint8_t i = 0; i < 4; i++, value >>= 4)
+			{
+				WriteNibble(block, ring.nibbles++, value & 0xF);
+			}
+		}
+		block[2]++;
+	}
+	ring.last = inTemp;
+}
+
+/******************************** WriteNibble *********************************/
+void TempHistory::WriteNibble(
+	uint8_t*	inBlock,
+	uint8_t		inNibbleIndex,
+	uint8_t		inValue)
+{
+	uint8_t&	thisByte = inBlock[kHeaderSize + inNibbleIndex/2];
+	if (inNibbleIndex & 1)
+	{
+		thisByte = (thisByte & 0x0F) | (inValue << 4);
+	} else
+	{
+		thisByte = (thisByte & 0xF0) | inValue;
+	}
+}
+
+/********************************* GetSummary *********************************/
+/*
+*	Decodes the ring from the oldest block to the newest.  The minimum and
+*	maximum include the readings of the current window, the mean is of the
+*	window means.
+*/
+bool TempHistory::GetSummary(
+	uint8_t					inIndex,
+	STempHistorySummary&	outSummary) const
+{
+	if (inIndex >= mCount)
+	{
+		return(false);
+	}
+	const STempHistoryRing&	ring = mRings[inIndex];
+	int32_t	sum = 0;
+	uint16_t	samples = 0;
+	outSummary.min = 0x7FFF;
+	outSummary.max = -0x8000;
+	uint8_t	blockIndex = ring.head + 1 + mBlocksPerSensor - ring.blocks;
+	if (blockIndex >= mBlocksPerSensor)
+	{
+		blockIndex -= mBlocksPerSensor;
+	}
+	for (uint8_t b = 0; b < ring.blocks; b++)
+	{
+		const uint8_t*	block = Block(inIndex, blockIndex);
+		int16_t	value;
+		memcpy(&value, block, sizeof(int16_t));
+		uint8_t	count = block[2];
+		uint8_t	nibbleIndex = 0;
+		for (uint8_t s = 0; s < count; s++)
+		{
+			if (s)
+			{
+				uint8_t	zigzag = ReadNibble(block, nibbleIndex++);
+				if (zigzag == kEscape)
+				{
+					uint16_t	absValue = 0;
+					for (uint8_t i = 0; i < 4; i++)
+					{
+						absValue |= (uint16_t)ReadNibble(block, nibbleIndex++) << (i*4);
+					}
+					value = absValue;
+				} else
+				{
+					value += (zigzag & 1) ? -(int16_t)((zigzag+1)/2) : (int16_t)(zigzag/2);
+				}
+			}
+			if (value < outSummary.min)
+			{
+				outSummary.min = value;
+			}
+			if (value > outSummary.max)
+			{
+				outSummary.max = value;
+			}
+			sum += value;
+			samples++;
+		}
+		blockIndex = blockIndex + 1 < mBlocksPerSensor ? blockIndex + 1 : 0;
+	}
+	if (ring.count)
+	{
+		if (ring.min < outSummary.min)
+		{
+			outSummary.min = ring.min;
+		}
+		if (ring.max > outSummary.max)
+		{
+			outSummary.max = ring.max;
+		}
+		if (samples == 0)
+		{
+			sum = ring.sum / ring.count;
+			samples = 1;
+		}
+	}
+	outSummary.samples = samples;
+	outSummary.mean = samples ? sum / samples : 0;
+	return(samples != 0);
+}
@@ -0,0 +1,161 @@
+/*
+*	TempHistory.h, Copyright (c) 2022 Jonathan Mackey
+*	Compact per sensor temperature history.
+*
+*	GNU license:
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU General Public License as published by
+*	the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU General Public License for more details.
+*
+*	You should have received a copy of the GNU General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*	Please maintain this license information along with authorship and copyright
+*	notices in any redistribution of this code.
+*
+*/
+#ifndef TempHistory_h
+#define TempHistory_h
+
+#include <inttypes.h>
+#include "MSPeriod.h"
+
+/*
+*	Per sensor ring and window state, 14 bytes.
+*/
+struct STempHistoryRing
+{
+	uint8_t		head;		// Index of the newest block
+	uint8_t		blocks;		// Blocks in use
+	uint8_t		nibbles;	// Nibbles used in the newest block
+	int16_t		last;		// Most recent sample appended
+	int16_t		min;		// Current window
+	int16_t		max;
+	int32_t		sum;
+	uint8_t		count;		// Readings in the current window
+};
+
+struct STempHistorySummary
+{
+	int16_t		min;		// 1/16 C
+	int16_t		max;
+	int16_t		mean;
+	uint16_t	samples;	// Windows in the history
+};
+
+/*
+*	The readings of each sensor are averaged over a window (e.g. 5 minutes.)
+*	At the end of each window the mean is appended to the sensor's ring.
+*
+*	Each ring is a circular list of kBlockSize byte blocks.  When the ring is
+*	full the oldest block is dropped.  A block starts with the absolute value
+*	of its first sample so that each block can be decoded on its own:
+*
+*	[0]		int16_t		first sample, 1/16 C
+*	[2]		uint8_t		samples in the block
+*	[3]		26 nibbles, low nibble first.  Each sample following the first is
+*			the zigzag encoded change from the previous sample (0 = 0, 1 = -1,
+*			2 = +1, 3 = -2, ...) when less than 15 (i.e. within +/-7/16 C),
+*			otherwise an escape nibble of 15 followed by the 4 nibble absolute
+*			value.
+*
+*	Memory per sample: 4 bits for a change within +/-7/16 C, 20 bits for an
+*	escape, plus the 3 byte block header.  A slowly changing temperature fits
+*	27 samples in 16 bytes (4.7 bits per sample.)  Appending is O(1), a few
+*	shifts and a nibble write, see MaxAppendTime().
+*/
+class TempHistory
+{
+public:
+	static const uint8_t	kBlockSize = 16;
+							TempHistory(
+								uint32_t				inWindowPeriod,
+								uint8_t					inCapacity,
+								uint8_t					inBlocksPerSensor,
+								uint8_t*				inBlocks,
+								STempHistoryRing*		inRings);
+	/*
+	*	Clears the history.  inCount is the number of sensors, up to the
+	*	capacity.  Should be called whenever the sensor indexes change.
+	*/
+	void					begin(
+								uint8_t					inCount);
+							// Adds a reading to the sensor's current window.
+	void					AddReading(
+								uint8_t					inIndex,
+								int16_t					inTemp);
+							// Returns true when a window has ended and its
+							// means have been appended.
+	bool					Update(void);
+							// Includes the current window.  Returns false
+							// if there is no history for inIndex.
+	bool					GetSummary(
+								uint8_t					inIndex,
+								STempHistorySummary&	outSummary) const;
+	uint8_t					GetCount(void) const
+								{return(mCount);}
+	uint32_t				WindowPeriod(void) const
+								{return(mWindowPeriod.Get());}
+	uint16_t				BytesPerSensor(void) const
+								{return(mBlocksPerSensor * kBlockSize);}
+							// Longest time to append a sample in us.
+	uint16_t				MaxAppendTime(void) const
+								{return(mMaxAppendTime);}
+protected:
+	MSPeriod			mWindowPeriod;
+	uint8_t*			mBlocks;
+	STempHistoryRing*	mRings;
+	uint8_t				mCapacity;
+	uint8_t				mCount;
+	uint8_t				mBlocksPerSensor;
+	uint16_t			mMaxAppendTime;
+	static const uint8_t	kHeaderSize = 3;
+	static const uint8_t	kMaxNibbles = (kBlockSize - kHeaderSize) * 2;
+	static const uint8_t	kEscape = 15;
+
+	inline uint8_t*			Block(
+								uint8_t					inIndex,
+								uint8_t					inBlock) const
+								{return(&mBlocks[((uint16_t)inIndex * mBlocksPerSensor + inBlock) * kBlockSize]);}
+	void					Append(
+								uint8_t					inIndex,
+								int16_t					inTemp);
+	static void				WriteNibble(
+								uint8_t*				inBlock,
+								uint8_t					inNibbleIndex,
+								uint8_t					inValue);
+	inline static uint8_t	ReadNibble(
+								const uint8_t*			inBlock,
+								uint8_t					inNibbleIndex)
+								{return((inBlock[kHeaderSize + inNibbleIndex/2] >>
+									((inNibbleIndex & 1) * 4)) & 0xF);}
+};
+
+/*
+*	TempHistoryN owns the storage for up to SENSORS sensors within BYTES of
+*	block storage (rounded down to whole blocks per sensor.)  Total SRAM used
+*	is the block storage plus 14 bytes per sensor.
+*/
+template<uint8_t SENSORS, uint16_t BYTES>
+class TempHistoryN : public TempHistory
+{
+public:
+							TempHistoryN(
+								uint32_t				inWindowPeriod)
+								: TempHistory(inWindowPeriod, SENSORS, kBlocksPerSensor,
+									mBlockStore, mRingStore){}
+protected:
+	static const uint8_t	kBlocksPerSensor = BYTES / SENSORS / kBlockSize;
+	static_assert(BYTES / SENSORS / kBlockSize >= 2 &&
+		BYTES / SENSORS / kBlockSize <= 255, "2 to 255 blocks per sensor");
+	uint8_t				mBlockStore[SENSORS * kBlocksPerSensor * kBlockSize];
+	STempHistoryRing	mRingStore[SENSORS];
+};
+
+#endif // TempHistory_h